@@ -0,0 +1,6 @@
+#include "basicpool.h"
+
+//常用的策略组合在动态库里实例化一次 头文件里的extern template声明让使用者不再各自生成
+template class BasicThreadPool<LockedQueue, BlockIdle, FixedSize, NoInstrumentation>;
+template class BasicThreadPool<LockFreeQueue, SpinIdle, FixedSize, NoInstrumentation>;
+template class BasicThreadPool<LockFreeQueue, BlockIdle, GrowOnDemand, CountingInstrumentation>;
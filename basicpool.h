@@ -0,0 +1,400 @@
+/*按策略在编译期组合的线程池 队列、空闲等待、线程数量和统计方式都是模板参数*/
+
+#ifndef BASICPOOL_H
+#define BASICPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+
+#include "threadpool.h"
+#include "ringqueue.h"
+#include "poolstats.h"
+
+/*
+ThreadPool的模式、队列、自旋都是运行时配置 工作线程的循环里每一步都要判断
+BasicThreadPool把这些选择变成模板参数 线程函数只包含选中的那一种实现 分支和空的统计调用都由编译器消掉
+
+QueuePolicy 任务队列
+    LockedQueue     互斥锁保护的deque
+    LockFreeQueue   有界无锁环形队列
+IdlePolicy 没有任务时工作线程怎么等
+    BlockIdle       直接在条件变量上睡眠
+    SpinIdle        先自旋一会儿再睡眠 突发的短任务不用经过睡眠和唤醒
+SizingPolicy 线程数量
+    FixedSize       start时创建 之后不变
+    GrowOnDemand    没有空闲线程并且排队的任务多于线程数量时增加线程 不超过上限 不回收
+InstrumentationPolicy 统计
+    NoInstrumentation       什么也不记 stats()只有线程和任务数量
+    CountingInstrumentation 另外记录提交、完成、睡眠次数 填入PoolStats里对应的字段
+
+默认参数BasicThreadPool<>就是ThreadPool 全部接口和运行时配置都不变
+其他组合只提供start/submitTask/submit 队列满时在提交任务的线程直接执行(等同于REJECT_CALLER_RUNS)
+没有优先级、截止时间、工作窃取和helpWait 任务里等待同一个线程池的结果可能死锁
+Result::then的后续任务在完成前一个任务的线程上直接执行
+常用的几种组合已经在线程池动态库里实例化 见文件末尾
+
+example:
+BasicThreadPool<LockFreeQueue, SpinIdle, FixedSize, NoInstrumentation> pool;
+pool.start(4);
+Result<int> res = pool.submit([](int a, int b) { return a + b; }, 1, 2);
+res.get();
+*/
+
+//运行时配置的策略 四个都是它们时BasicThreadPool就是ThreadPool
+struct RuntimeQueue {};
+struct RuntimeIdle {};
+struct RuntimeSizing {};
+struct RuntimeInstrumentation {};
+
+//互斥锁保护的deque 容量为0表示不限制
+class LockedQueue
+{
+public:
+    explicit LockedQueue(size_t capacity)
+        : capacity_(capacity)
+    {}
+
+    bool push(std::shared_ptr<Task>&& task)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        if (capacity_ != 0 && que_.size() >= capacity_)
+            return false;
+        que_.push_back(std::move(task));
+        return true;
+    }
+
+    bool pop(std::shared_ptr<Task>& task)
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        if (que_.empty())
+            return false;
+        task = std::move(que_.front());
+        que_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mtx_;
+    std::deque<std::shared_ptr<Task>> que_;
+    size_t capacity_;
+};
+
+//有界无锁环形队列 容量向上取整到2的幂 为0时取65536
+class LockFreeQueue
+{
+public:
+    explicit LockFreeQueue(size_t capacity)
+        : ring_(capacity == 0 ? (size_t)1 << 16 : capacity)
+    {}
+
+    bool push(std::shared_ptr<Task>&& task)
+    {
+        return ring_.push(std::move(task));
+    }
+
+    bool pop(std::shared_ptr<Task>& task)
+    {
+        return ring_.pop(task);
+    }
+
+private:
+    RingQueue<std::shared_ptr<Task>> ring_;
+};
+
+//没有任务时在条件变量上睡眠
+//提交方先增加任务数量再检查睡眠线程数量 工作线程先登记睡眠再检查任务数量 两边都是seq_cst 不会漏掉唤醒
+class BlockIdle
+{
+public:
+    template<typename Pred>
+    void wait(Pred ready)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        sleepers_++;
+        cond_.wait(lock, ready);
+        sleepers_--;
+    }
+
+    //有新任务 有线程在睡眠时唤醒一个
+    void notifyOne()
+    {
+        if (sleepers_ > 0)
+        {
+            std::lock_guard<std::mutex> guard(mtx_);
+            cond_.notify_one();
+        }
+    }
+
+    void notifyAll()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        cond_.notify_all();
+    }
+
+private:
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::atomic_int sleepers_{ 0 };
+};
+
+//先自旋SPIN_COUNT次再睡眠
+class SpinIdle : public BlockIdle
+{
+public:
+    static const int SPIN_COUNT = 2000;
+
+    template<typename Pred>
+    void wait(Pred ready)
+    {
+        for (int i = 0; i < SPIN_COUNT; i++)
+        {
+            if (ready())
+                return;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__)
+            asm volatile("yield");
+#endif
+        }
+        BlockIdle::wait(ready);
+    }
+};
+
+//线程数量固定
+struct FixedSize
+{
+    bool shouldGrow(long long pending, int idle, int threads) const
+    {
+        (void)pending;
+        (void)idle;
+        (void)threads;
+        return false;
+    }
+};
+
+//所有线程都在忙并且每个线程后面都排着不止一个任务时增加一个线程 最多maxThreads_个
+//只比较空闲线程数量会在短任务的正常排队里不停扩容
+struct GrowOnDemand
+{
+    int maxThreads_ = 1024;
+
+    bool shouldGrow(long long pending, int idle, int threads) const
+    {
+        return idle == 0 && pending > threads && threads < maxThreads_;
+    }
+};
+
+//不统计 所有调用都是空函数
+struct NoInstrumentation
+{
+    void submitted() {}
+    void callerRuns() {}
+    void completed() {}
+    void parked() {}
+    void threadCreated() {}
+    void fill(PoolStats&) const {}
+};
+
+//原子计数 统计项和ThreadPool::stats()的同名字段含义相同
+struct CountingInstrumentation
+{
+    void submitted() { submitted_.fetch_add(1, std::memory_order_relaxed); }
+    void callerRuns() { callerRuns_.fetch_add(1, std::memory_order_relaxed); }
+    void completed() { completed_.fetch_add(1, std::memory_order_relaxed); }
+    void parked() { parks_.fetch_add(1, std::memory_order_relaxed); }
+    void threadCreated() { threadsCreated_.fetch_add(1, std::memory_order_relaxed); }
+
+    void fill(PoolStats& stats) const
+    {
+        stats.submitted = submitted_.load(std::memory_order_relaxed);
+        stats.callerRuns = callerRuns_.load(std::memory_order_relaxed);
+        stats.completed = completed_.load(std::memory_order_relaxed);
+        stats.parks = parks_.load(std::memory_order_relaxed);
+        stats.threadsCreated = threadsCreated_.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> submitted_{ 0 };
+    std::atomic<uint64_t> callerRuns_{ 0 };
+    std::atomic<uint64_t> completed_{ 0 };
+    std::atomic<uint64_t> parks_{ 0 };
+    std::atomic<uint64_t> threadsCreated_{ 0 };
+};
+
+template<typename QueuePolicy = RuntimeQueue, typename IdlePolicy = RuntimeIdle,
+    typename SizingPolicy = RuntimeSizing, typename InstrumentationPolicy = RuntimeInstrumentation>
+class BasicThreadPool
+{
+public:
+    //capacity是任务队列的容量 0表示队列的默认值
+    explicit BasicThreadPool(size_t capacity = 0, SizingPolicy sizing = SizingPolicy())
+        : que_(capacity)
+        , sizing_(sizing)
+    {}
+
+    //等待队列里的任务全部执行完 再回收所有线程
+    ~BasicThreadPool()
+    {
+        isPoolRunning_ = false;
+        idle_.notifyAll();
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> guard(threadsMtx_);
+            threads.swap(threads_);
+        }
+        for (std::thread& t : threads)
+            t.join();
+    }
+
+    BasicThreadPool(const BasicThreadPool&) = delete;
+    BasicThreadPool& operator=(const BasicThreadPool&) = delete;
+
+    //启动initThreadSize个工作线程 只能调用一次
+    void start(int initThreadSize = (int)std::thread::hardware_concurrency())
+    {
+        if (isPoolRunning_.exchange(true))
+            throw "thread pool already started!";
+        std::lock_guard<std::mutex> guard(threadsMtx_);
+        for (int i = 0; i < std::max(initThreadSize, 1); i++)
+            addThread();
+    }
+
+    //提交任务 队列满时在当前线程执行
+    Result<> submitTask(std::shared_ptr<Task> sp)
+    {
+        enqueue(sp);
+        return Result<>(std::move(sp), true);
+    }
+
+    //提交任意可调用对象和参数 返回带类型的Result<T>
+    template<typename Func, typename... Args>
+    auto submit(Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        using RType = typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type;
+        auto call = [func = std::forward<Func>(func), args = std::make_tuple(std::forward<Args>(args)...)]() mutable -> RType
+        {
+            return std::apply(func, std::move(args));
+        };
+        auto task = allocateShared<FuncTask<RType, decltype(call)>>(std::move(call));
+        enqueue(task);
+        return Result<RType>(std::move(task), true);
+    }
+
+    //排队还没开始执行的任务数量(近似值)
+    long long pending() const
+    {
+        return taskSize_.load(std::memory_order_relaxed);
+    }
+
+    //工作线程数量
+    int threadCount() const
+    {
+        return curThreadSize_.load(std::memory_order_relaxed);
+    }
+
+    //统计快照 没有记录的字段为0
+    PoolStats stats() const
+    {
+        PoolStats result;
+        instrumentation_.fill(result);
+        result.curThreadSize = curThreadSize_;
+        result.idleThreadSize = idleThreadSize_;
+        result.taskSize = (int)taskSize_.load();
+        return result;
+    }
+
+private:
+    void enqueue(std::shared_ptr<Task> task)
+    {
+        //先增加任务数量再入队 工作线程看到的数量不会少于队列里的任务
+        taskSize_++;
+        if (!que_.push(std::move(task)))
+        {
+            taskSize_--;
+            instrumentation_.callerRuns();
+            //push失败时task没有被移走
+            task->exec();
+            return;
+        }
+        instrumentation_.submitted();
+        idle_.notifyOne();
+        if (sizing_.shouldGrow(taskSize_.load(std::memory_order_relaxed), idleThreadSize_.load(std::memory_order_relaxed),
+            curThreadSize_.load(std::memory_order_relaxed)))
+        {
+            std::lock_guard<std::mutex> guard(threadsMtx_);
+            //并发提交时可能多个线程同时判断需要扩容 持锁后再判断一次 析构开始后不再创建
+            if (isPoolRunning_ && sizing_.shouldGrow(taskSize_, idleThreadSize_, curThreadSize_))
+            {
+                addThread();
+                instrumentation_.threadCreated();
+            }
+        }
+    }
+
+    //创建一个工作线程 调用者必须持有threadsMtx_
+    void addThread()
+    {
+        curThreadSize_++;
+        idleThreadSize_++;
+        threads_.emplace_back(&BasicThreadPool::ThreadFunc, this);
+    }
+
+    //线程函数 线程池析构时把队列里的任务执行完再退出
+    void ThreadFunc()
+    {
+        for (;;)
+        {
+            std::shared_ptr<Task> task;
+            if (que_.pop(task))
+            {
+                taskSize_--;
+                idleThreadSize_--;
+                task->exec();
+                instrumentation_.completed();
+                idleThreadSize_++;
+                continue;
+            }
+            if (!isPoolRunning_ && taskSize_ <= 0)
+                return;
+            instrumentation_.parked();
+            idle_.wait([this]() { return taskSize_ > 0 || !isPoolRunning_; });
+        }
+    }
+
+    QueuePolicy que_;
+    IdlePolicy idle_;
+    SizingPolicy sizing_;
+    InstrumentationPolicy instrumentation_;
+
+    std::atomic<long long> taskSize_{ 0 };
+    std::atomic_int curThreadSize_{ 0 };
+    std::atomic_int idleThreadSize_{ 0 };
+    std::atomic_bool isPoolRunning_{ false };
+    std::mutex threadsMtx_;
+    std::vector<std::thread> threads_;
+};
+
+//默认参数 运行时配置的ThreadPool
+template<>
+class BasicThreadPool<RuntimeQueue, RuntimeIdle, RuntimeSizing, RuntimeInstrumentation> : public ThreadPool
+{
+public:
+    using ThreadPool::ThreadPool;
+};
+
+//线程池动态库里已经实例化的组合 使用它们不需要在每个编译单元里重新生成代码
+extern template class BasicThreadPool<LockedQueue, BlockIdle, FixedSize, NoInstrumentation>;
+extern template class BasicThreadPool<LockFreeQueue, SpinIdle, FixedSize, NoInstrumentation>;
+extern template class BasicThreadPool<LockFreeQueue, BlockIdle, GrowOnDemand, CountingInstrumentation>;
+
+#endif
@@ -0,0 +1,421 @@
+/*C++20协程接入线程池 co_await schedule(pool) / co_await Result / CoTask<T>*/
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+//库本身按C++17编译 只有用C++20(开启协程)编译的代码才能使用这个头文件里的内容
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <stddef.h>
+
+#include "threadpool.h"
+#include "poolalloc.h"
+
+/*
+协程和线程池之间不再需要用Result::get()阻塞一个线程
+co_await schedule(pool)        把当前协程挂起 交给线程池的工作线程恢复执行
+co_await pool.submit(f, ...)   任务完成时恢复等待的协程 等待期间不占用任何线程
+CoTask<T>                      惰性协程 被co_await时才开始执行 协程帧从PoolArena分配
+syncWait(task)                 在普通函数里等待协程的结果 工作线程上调用时等待期间执行排队的任务
+spawn(pool, task)              在线程池上启动协程 不等待它结束
+
+恢复协程的任务从完成被等待任务的线程提交 工作窃取模式下放入这个线程的本地队列 协程的数据还在它的缓存里
+队列满提交失败时在当前线程直接恢复 协程不会丢失
+
+example:
+CoTask<int> handle(ThreadPool& pool, int req)
+{
+    co_await schedule(pool);
+    int a = co_await pool.submit(parse, req);
+    int b = co_await lookup(pool, a); //lookup也是CoTask<int>
+    co_return a + b;
+}
+int value = syncWait(handle(pool, 1));
+*/
+
+namespace detail
+{
+    //把协程交给线程池恢复 提交失败返回false 由调用者在当前线程恢复
+    inline bool resumeOnPool(ThreadPool* pool, std::coroutine_handle<> handle)
+    {
+        return pool != nullptr && pool->trySubmit([handle]() { handle.resume(); }).valid();
+    }
+
+    //通过共享句柄恢复 线程池已经析构时返回false
+    inline bool resumeOnPool(PoolHandle* pool, std::coroutine_handle<> handle)
+    {
+        auto call = [handle]() { handle.resume(); };
+        return pool != nullptr && pool->trySubmitTask(allocateShared<FuncTask<void, decltype(call)>>(std::move(call)));
+    }
+
+    //协程帧从PoolArena分配 和任务对象使用同一个分配器
+    struct ArenaFrame
+    {
+        static void* operator new(size_t size)
+        {
+            return PoolArena::allocate(size);
+        }
+        static void operator delete(void* ptr, size_t size)
+        {
+            PoolArena::deallocate(ptr, size);
+        }
+    };
+
+    //保存协程的返回值或者异常
+    template<typename T>
+    class CoResult
+    {
+    public:
+        template<typename U>
+        void return_value(U&& value)
+        {
+            result_.template emplace<1>(std::forward<U>(value));
+        }
+
+        void unhandled_exception()
+        {
+            result_.template emplace<2>(std::current_exception());
+        }
+
+        //取走返回值 协程抛出异常时重新抛出
+        T take()
+        {
+            if (result_.index() == 2)
+                std::rethrow_exception(std::get<2>(result_));
+            return std::move(std::get<1>(result_));
+        }
+
+    private:
+        std::variant<std::monostate, T, std::exception_ptr> result_;
+    };
+
+    template<>
+    class CoResult<void>
+    {
+    public:
+        void return_void()
+        {}
+
+        void unhandled_exception()
+        {
+            error_ = std::current_exception();
+        }
+
+        void take()
+        {
+            if (error_)
+                std::rethrow_exception(error_);
+        }
+
+    private:
+        std::exception_ptr error_;
+    };
+}
+
+//co_await schedule(pool)的等待体
+class ScheduleAwaiter
+{
+public:
+    explicit ScheduleAwaiter(ThreadPool& pool)
+        : pool_(pool)
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    //提交失败时不挂起 协程在当前线程继续执行
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        return detail::resumeOnPool(&pool_, handle);
+    }
+
+    void await_resume() const noexcept
+    {}
+
+private:
+    ThreadPool& pool_;
+};
+
+//挂起当前协程 在线程池的工作线程上恢复
+inline ScheduleAwaiter schedule(ThreadPool& pool)
+{
+    return ScheduleAwaiter(pool);
+}
+
+//co_await Result的等待体 任务完成时把协程交给同一个线程池恢复
+template<typename T>
+class ResultAwaiter
+{
+public:
+    explicit ResultAwaiter(Result<T>&& result)
+        : result_(std::move(result))
+    {}
+
+    //提交失败的Result直接在await_resume里按get的方式报错
+    bool await_ready() const noexcept
+    {
+        return !result_.isValid_ || result_.ready();
+    }
+
+    //登记之后协程可能马上在其他线程恢复并销毁这个等待体 登记后不能再访问成员
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        Task* task = result_.task_.get();
+        std::shared_ptr<PoolHandle> pool = task->pool_;
+        task->addContinuation([pool, handle]() {
+            if (!detail::resumeOnPool(pool.get(), handle))
+                handle.resume();
+        });
+    }
+
+    T await_resume()
+    {
+        return result_.get();
+    }
+
+private:
+    Result<T> result_;
+};
+
+//co_await pool.submit(...) 不阻塞线程地等待任务的返回值 Result只能等待一次 所以只接受右值
+template<typename T>
+ResultAwaiter<T> operator co_await(Result<T>&& result)
+{
+    return ResultAwaiter<T>(std::move(result));
+}
+
+//惰性协程 被co_await或者交给syncWait/spawn时才开始执行 返回值只能取一次
+template<typename T = void>
+class CoTask
+{
+public:
+    struct promise_type : detail::ArenaFrame, detail::CoResult<T>
+    {
+        CoTask get_return_object()
+        {
+            return CoTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        //执行完直接切换到等待它的协程 不经过线程池 也不加深线程栈
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                std::coroutine_handle<> next = handle.promise().continuation_;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() const noexcept
+            {}
+        };
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::coroutine_handle<> continuation_; //等待这个协程的协程
+    };
+
+    CoTask(CoTask&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr))
+    {}
+    CoTask& operator=(CoTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle_)
+                handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+    ~CoTask()
+    {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    //co_await task 在当前线程开始执行 执行完后恢复等待者
+    class Awaiter
+    {
+    public:
+        explicit Awaiter(std::coroutine_handle<promise_type> handle)
+            : handle_(handle)
+        {}
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            handle_.promise().continuation_ = awaiting;
+            return handle_;
+        }
+
+        T await_resume()
+        {
+            return handle_.promise().take();
+        }
+
+    private:
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    Awaiter operator co_await() && noexcept
+    {
+        return Awaiter(handle_);
+    }
+
+private:
+    explicit CoTask(std::coroutine_handle<promise_type> handle)
+        : handle_(handle)
+    {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail
+{
+    //syncWait使用的协程 立即开始执行 结束时通知等待的线程 协程帧由SyncWaiter销毁
+    template<typename T>
+    class SyncWaiter
+    {
+    public:
+        struct promise_type : ArenaFrame, CoResult<T>
+        {
+            SyncWaiter get_return_object()
+            {
+                return SyncWaiter(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            struct FinalAwaiter
+            {
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+                void await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    handle.promise().done_.set();
+                }
+                void await_resume() const noexcept
+                {}
+            };
+
+            FinalAwaiter final_suspend() noexcept
+            {
+                return {};
+            }
+
+            Completion done_;
+        };
+
+        SyncWaiter(const SyncWaiter&) = delete;
+        SyncWaiter& operator=(const SyncWaiter&) = delete;
+        ~SyncWaiter()
+        {
+            handle_.destroy();
+        }
+
+        T get()
+        {
+            helpWait(handle_.promise().done_);
+            return handle_.promise().take();
+        }
+
+    private:
+        explicit SyncWaiter(std::coroutine_handle<promise_type> handle)
+            : handle_(handle)
+        {}
+
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    template<typename T>
+    SyncWaiter<T> syncWaitBody(CoTask<T> task)
+    {
+        co_return co_await std::move(task);
+    }
+
+    template<>
+    inline SyncWaiter<void> syncWaitBody(CoTask<void> task)
+    {
+        co_await std::move(task);
+    }
+
+    //spawn使用的协程 结束后自己销毁协程帧
+    struct Detached
+    {
+        struct promise_type : ArenaFrame
+        {
+            Detached get_return_object()
+            {
+                return {};
+            }
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+            std::suspend_never final_suspend() noexcept
+            {
+                return {};
+            }
+            void return_void()
+            {}
+            //和std::thread一样 没有人能接收分离执行的协程抛出的异常
+            void unhandled_exception()
+            {
+                std::terminate();
+            }
+        };
+    };
+
+    inline Detached spawnBody(ThreadPool& pool, CoTask<void> task)
+    {
+        co_await schedule(pool);
+        co_await std::move(task);
+    }
+}
+
+//在普通函数里执行协程并等待结果 协程抛出的异常在这里重新抛出
+template<typename T>
+T syncWait(CoTask<T> task)
+{
+    return detail::syncWaitBody(std::move(task)).get();
+}
+
+//在线程池上启动协程 不等待它结束 协程抛出异常时终止程序
+inline void spawn(ThreadPool& pool, CoTask<void> task)
+{
+    detail::spawnBody(pool, std::move(task));
+}
+
+#endif
+
+#endif
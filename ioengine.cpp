@@ -0,0 +1,428 @@
+#include "ioengine.h"
+#include "logger.h"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+//io_uring只在Linux上有 不依赖liburing 直接用系统调用和共享内存操作环形队列
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define IOENGINE_URING
+#endif
+#endif
+
+IoEngine::IoEngine(ThreadPool& pool, unsigned depth, IoBackend backend, int threads)
+    : pool_(pool)
+    , backend_(IoBackend::IO_THREADS)
+    , depth_(depth > 0 ? depth : 1)
+{
+    if (backend != IoBackend::IO_THREADS && setupUring(depth_))
+    {
+        backend_ = IoBackend::IO_URING;
+        reaper_ = std::thread(&IoEngine::ReapFunc, this);
+        return;
+    }
+    if (backend == IoBackend::IO_URING)
+    {
+        throw "io_uring unavailable!";
+    }
+    startThreads(threads);
+}
+
+IoEngine::~IoEngine()
+{
+    if (backend_ == IoBackend::IO_URING)
+    {
+        //提交一个空操作唤醒收割线程 它收完所有已提交的I/O后退出
+        //先计入空操作再标记退出 收割线程不会在收到空操作之前看到没有I/O
+        Request* wake = new Request;
+        {
+            std::unique_lock<std::mutex> lock(submitMtx_);
+            notFull_.wait(lock, [this]() { return inflight_ < depth_; });
+            inflight_++;
+            exiting_ = true;
+            pushUring(wake);
+        }
+        reaper_.join();
+        closeUring();
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> guard(queMtx_);
+            exiting_ = true;
+        }
+        queCond_.notify_all();
+        for (std::thread& t : ioThreads_)
+            t.join();
+    }
+}
+
+Result<long> IoEngine::read(int fd, void* buf, size_t len, int64_t offset)
+{
+    return submitOp(OP_READ, fd, buf, len, offset, -1);
+}
+
+Result<long> IoEngine::write(int fd, const void* buf, size_t len, int64_t offset)
+{
+    return submitOp(OP_WRITE, fd, const_cast<void*>(buf), len, offset, -1);
+}
+
+Result<long> IoEngine::fsync(int fd)
+{
+    return submitOp(OP_FSYNC, fd, nullptr, 0, 0, -1);
+}
+
+bool IoEngine::registerBuffers(const std::vector<iovec>& buffers)
+{
+    std::lock_guard<std::mutex> guard(submitMtx_);
+    if (!buffers_.empty())
+    {
+        throw "io buffers already registered!";
+    }
+    buffers_ = buffers;
+#ifdef IOENGINE_URING
+    if (backend_ == IoBackend::IO_URING && !buffers_.empty())
+    {
+        int ret = (int)syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_BUFFERS,
+            buffers_.data(), (unsigned)buffers_.size());
+        if (ret < 0)
+            POOL_LOG_WARN("io_uring register buffers fail, fixed io uses plain io. errno:", errno);
+        else
+            buffersRegistered_ = true;
+    }
+#endif
+    return buffersRegistered_;
+}
+
+Result<long> IoEngine::readFixed(int fd, int bufIndex, size_t bufOffset, size_t len, int64_t offset)
+{
+    return submitOp(OP_READ_FIXED, fd, fixedAddress(bufIndex, bufOffset, len), len, offset, bufIndex);
+}
+
+Result<long> IoEngine::writeFixed(int fd, int bufIndex, size_t bufOffset, size_t len, int64_t offset)
+{
+    return submitOp(OP_WRITE_FIXED, fd, fixedAddress(bufIndex, bufOffset, len), len, offset, bufIndex);
+}
+
+IoBackend IoEngine::backend() const
+{
+    return backend_;
+}
+
+size_t IoEngine::inflight() const
+{
+    return inflight_;
+}
+
+Result<long> IoEngine::submitOp(IoOp op, int fd, void* buf, size_t len, int64_t offset, int bufIndex)
+{
+    Request* req = new Request;
+    req->op_ = op;
+    req->fd_ = fd;
+    req->buf_ = buf;
+    req->len_ = len;
+    req->offset_ = offset;
+    req->bufIndex_ = bufIndex;
+
+    //Result的任务只取出I/O的结果 由完成I/O的线程直接执行 then的后续任务提交到pool_
+    auto call = [req]() -> long { return req->res_; };
+    auto task = allocateShared<FuncTask<long, decltype(call)>>(std::move(call));
+    task->pool_ = pool_.handle_;
+    req->task_ = task;
+
+    {
+        std::unique_lock<std::mutex> lock(submitMtx_);
+        notFull_.wait(lock, [this]() { return inflight_ < depth_; });
+        inflight_++;
+        if (backend_ == IoBackend::IO_URING)
+            pushUring(req);
+    }
+    if (backend_ == IoBackend::IO_THREADS)
+    {
+        {
+            std::lock_guard<std::mutex> guard(queMtx_);
+            que_.push_back(req);
+        }
+        queCond_.notify_one();
+    }
+    return Result<long>(std::move(task), true);
+}
+
+char* IoEngine::fixedAddress(int bufIndex, size_t bufOffset, size_t len) const
+{
+    if (bufIndex < 0 || (size_t)bufIndex >= buffers_.size())
+    {
+        throw "io buffer index out of range!";
+    }
+    const iovec& buffer = buffers_[bufIndex];
+    if (bufOffset > buffer.iov_len || len > buffer.iov_len - bufOffset)
+    {
+        throw "io buffer range out of range!";
+    }
+    return static_cast<char*>(buffer.iov_base) + bufOffset;
+}
+
+void IoEngine::finish(Request* req, long res)
+{
+    req->res_ = res;
+    if (req->task_ != nullptr)
+        req->task_->exec();
+    delete req;
+
+    //从满变为不满时唤醒等待的提交者 加锁保证它们已经在等待
+    if (inflight_.fetch_sub(1) == depth_)
+    {
+        std::lock_guard<std::mutex> guard(submitMtx_);
+        notFull_.notify_all();
+    }
+}
+
+long IoEngine::runSync(const Request* req)
+{
+    ssize_t res = 0;
+    do
+    {
+        switch (req->op_)
+        {
+        case OP_READ:
+        case OP_READ_FIXED:
+            res = req->offset_ < 0 ? ::read(req->fd_, req->buf_, req->len_)
+                : ::pread(req->fd_, req->buf_, req->len_, (off_t)req->offset_);
+            break;
+        case OP_WRITE:
+        case OP_WRITE_FIXED:
+            res = req->offset_ < 0 ? ::write(req->fd_, req->buf_, req->len_)
+                : ::pwrite(req->fd_, req->buf_, req->len_, (off_t)req->offset_);
+            break;
+        case OP_FSYNC:
+            res = ::fsync(req->fd_);
+            break;
+        default:
+            res = 0;
+            break;
+        }
+    } while (res < 0 && errno == EINTR);
+    return res < 0 ? -errno : (long)res;
+}
+
+#ifdef IOENGINE_URING
+
+bool IoEngine::setupUring(unsigned depth)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    int fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+    if (fd < 0)
+    {
+        POOL_LOG_WARN("io_uring setup fail, use io threads. errno:", errno);
+        return false;
+    }
+    //需要IORING_OP_READ/WRITE和offset为-1时使用文件当前位置(5.6)
+    if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+    {
+        POOL_LOG_WARN("io_uring too old, use io threads.");
+        ::close(fd);
+        return false;
+    }
+    ringFd_ = fd;
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+        sqRing_ = nullptr;
+    cqRing_ = singleMmap ? sqRing_
+        : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED)
+        cqRing_ = nullptr;
+    sqes_ = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED)
+        sqes_ = nullptr;
+    if (sqRing_ == nullptr || cqRing_ == nullptr || sqes_ == nullptr)
+    {
+        POOL_LOG_WARN("io_uring mmap fail, use io threads. errno:", errno);
+        closeUring();
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = cq + params.cq_off.cqes;
+
+    //在内核里的I/O不超过提交队列的大小 完成队列是它的两倍 不会溢出
+    if (depth_ > params.sq_entries)
+        depth_ = params.sq_entries;
+    return true;
+}
+
+void IoEngine::closeUring()
+{
+    if (sqes_ != nullptr)
+        munmap(sqes_, sqesSize_);
+    if (cqRing_ != nullptr && cqRing_ != sqRing_)
+        munmap(cqRing_, cqRingSize_);
+    if (sqRing_ != nullptr)
+        munmap(sqRing_, sqRingSize_);
+    sqes_ = sqRing_ = cqRing_ = nullptr;
+    if (ringFd_ >= 0)
+        ::close(ringFd_);
+    ringFd_ = -1;
+}
+
+//填写一个提交队列项并提交 调用者必须持有submitMtx_
+void IoEngine::pushUring(Request* req)
+{
+    unsigned tail = *sqTail_;
+    unsigned index = tail & sqMask_;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = req->fd_;
+    sqe->addr = (uint64_t)(uintptr_t)req->buf_;
+    sqe->len = (uint32_t)req->len_;
+    sqe->off = (uint64_t)req->offset_; //-1表示文件当前位置
+    sqe->user_data = (uint64_t)(uintptr_t)req;
+    switch (req->op_)
+    {
+    case OP_READ:
+        sqe->opcode = IORING_OP_READ;
+        break;
+    case OP_WRITE:
+        sqe->opcode = IORING_OP_WRITE;
+        break;
+    case OP_FSYNC:
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->off = 0;
+        break;
+    case OP_READ_FIXED:
+        sqe->opcode = buffersRegistered_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->buf_index = (uint16_t)req->bufIndex_;
+        break;
+    case OP_WRITE_FIXED:
+        sqe->opcode = buffersRegistered_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->buf_index = (uint16_t)req->bufIndex_;
+        break;
+    default:
+        sqe->opcode = IORING_OP_NOP;
+        break;
+    }
+    sqArray_[index] = index;
+    req->posted_.store(true, std::memory_order_release);
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+    //提交数量受depth_限制 完成队列不会满 被信号打断或者内核暂时没有内存时重试
+    for (;;)
+    {
+        int ret = (int)syscall(__NR_io_uring_enter, ringFd_, 1, 0, 0, nullptr, 0);
+        if (ret > 0)
+            break;
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            //留在提交队列里 下一次提交时一起交给内核
+            POOL_LOG_ERROR("io_uring submit fail. errno:", errno);
+            break;
+        }
+        std::this_thread::yield();
+    }
+}
+
+//收割线程 取出完成队列里的所有完成项 逐个完成Result 没有时在内核里等待
+void IoEngine::ReapFunc()
+{
+    std::vector<std::pair<Request*, long>> done;
+    io_uring_cqe* cqes = static_cast<io_uring_cqe*>(cqes_);
+    for (;;)
+    {
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            if (exiting_ && inflight_ == 0)
+                break;
+            int ret = (int)syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (ret < 0 && errno != EINTR)
+            {
+                POOL_LOG_ERROR("io_uring wait fail. errno:", errno);
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        //先把完成项复制出来 归还完成队列的位置 再执行可能比较慢的完成通知
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe& cqe = cqes[head & cqMask_];
+            done.emplace_back(reinterpret_cast<Request*>((uintptr_t)cqe.user_data), (long)cqe.res);
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        for (auto& item : done)
+        {
+            //提交线程对请求的写入经过内核已经可见 内存模型看不到内核 这里用posted_显式建立先后关系
+            item.first->posted_.load(std::memory_order_acquire);
+            finish(item.first, item.second);
+        }
+        done.clear();
+    }
+}
+
+#else
+
+bool IoEngine::setupUring(unsigned)
+{
+    return false;
+}
+
+void IoEngine::closeUring()
+{}
+
+void IoEngine::pushUring(Request*)
+{}
+
+void IoEngine::ReapFunc()
+{}
+
+#endif
+
+void IoEngine::startThreads(int threads)
+{
+    if (threads < 1)
+        threads = 1;
+    for (int i = 0; i < threads; i++)
+        ioThreads_.emplace_back(&IoEngine::IoThreadFunc, this);
+}
+
+//I/O线程 阻塞地执行请求 析构时执行完队列里剩下的请求再退出
+void IoEngine::IoThreadFunc()
+{
+    for (;;)
+    {
+        Request* req = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(queMtx_);
+            queCond_.wait(lock, [this]() { return exiting_ || !que_.empty(); });
+            if (que_.empty())
+                return;
+            req = que_.front();
+            que_.pop_front();
+        }
+        finish(req, runSync(req));
+    }
+}
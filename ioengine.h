@@ -0,0 +1,176 @@
+/*异步文件I/O 读写在内核或I/O线程里完成 完成后通过Result交回线程池*/
+
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "threadpool.h"
+
+//I/O的执行方式
+enum class IoBackend
+{
+    IO_AUTO,    //优先io_uring 内核不支持或被禁止时使用I/O线程
+    IO_URING,   //只用io_uring 不可用时构造函数抛出异常
+    IO_THREADS, //I/O线程阻塞地读写 不占用线程池的工作线程
+};
+
+/*
+任务里阻塞地读文件会占住一个工作线程 读的时候它什么也做不了
+IoEngine把读写交给内核(io_uring)或者专门的I/O线程 提交后立即返回Result<long>
+I/O完成时由收割线程完成Result 之后的then/co_await/get都回到线程池的工作线程上执行 等待期间不占用任何线程
+Result的值和系统调用一样：成功时是读写的字节数 失败时是-errno
+
+offset小于0表示从文件当前位置读写 管道、socket这类不能定位的文件必须这样
+同一个fd上并发的多个请求不保证执行顺序 需要顺序时用then串起来或者指定offset
+
+registerBuffers登记的缓冲区在io_uring里预先固定并映射 readFixed/writeFixed每次不再映射用户内存
+登记失败(例如超过RLIMIT_MEMLOCK)时固定缓冲区的读写按普通读写执行 结果相同
+
+析构时等待所有已经提交的I/O完成 管道上没有数据的读会一直等 要先让对端写入或者关闭
+IoEngine必须在它使用的ThreadPool之前析构
+
+example:
+ThreadPool pool;
+pool.start(4);
+IoEngine io(pool);
+int fd = open("data.bin", O_RDONLY);
+std::vector<char> buf(4096);
+Result<size_t> lines = io.read(fd, buf.data(), buf.size(), 0).then([&buf](long n) {
+    return n < 0 ? 0 : (size_t)std::count(buf.data(), buf.data() + n, '\n');
+});
+lines.get();
+*/
+class IoEngine
+{
+public:
+    //depth是同时在内核里的I/O数量上限 超过时提交者等待 threads是I/O线程方式下的线程数量
+    explicit IoEngine(ThreadPool& pool, unsigned depth = 256, IoBackend backend = IoBackend::IO_AUTO, int threads = 2);
+    ~IoEngine();
+    IoEngine(const IoEngine&) = delete;
+    IoEngine& operator=(const IoEngine&) = delete;
+
+    //从fd读最多len字节到buf 完成前buf必须一直有效
+    Result<long> read(int fd, void* buf, size_t len, int64_t offset = -1);
+
+    //把buf的len字节写到fd
+    Result<long> write(int fd, const void* buf, size_t len, int64_t offset = -1);
+
+    //把fd的数据刷到磁盘 成功时值为0
+    Result<long> fsync(int fd);
+
+    //登记固定缓冲区 下标就是之后readFixed/writeFixed的bufIndex 只能调用一次 应该在提交I/O之前调用
+    //返回缓冲区是否在内核里登记成功 失败时仍然可以使用固定缓冲区的接口
+    bool registerBuffers(const std::vector<iovec>& buffers);
+
+    //读到第bufIndex个固定缓冲区的bufOffset处 超出缓冲区范围时抛出异常
+    Result<long> readFixed(int fd, int bufIndex, size_t bufOffset, size_t len, int64_t offset = -1);
+
+    //把第bufIndex个固定缓冲区bufOffset处的len字节写到fd
+    Result<long> writeFixed(int fd, int bufIndex, size_t bufOffset, size_t len, int64_t offset = -1);
+
+    //实际使用的执行方式 IO_URING或IO_THREADS
+    IoBackend backend() const;
+
+    //已经提交还没完成的I/O数量
+    size_t inflight() const;
+
+private:
+    enum IoOp
+    {
+        OP_NOP,
+        OP_READ,
+        OP_WRITE,
+        OP_FSYNC,
+        OP_READ_FIXED,
+        OP_WRITE_FIXED,
+    };
+
+    //一次I/O请求 完成后执行task_通知Result 然后释放
+    struct Request
+    {
+        IoOp op_ = OP_NOP;
+        int fd_ = -1;
+        void* buf_ = nullptr;
+        size_t len_ = 0;
+        int64_t offset_ = -1;
+        int bufIndex_ = -1;
+        long res_ = 0;
+        std::shared_ptr<Task> task_;
+        std::atomic_bool posted_{ false }; //交给内核之前置位 收割线程读它和提交线程建立先后关系
+
+        static void* operator new(size_t size)
+        {
+            return PoolArena::allocate(size);
+        }
+        static void operator delete(void* ptr, size_t size)
+        {
+            PoolArena::deallocate(ptr, size);
+        }
+    };
+
+    //创建请求和它的Result 请求交给执行方式后返回
+    Result<long> submitOp(IoOp op, int fd, void* buf, size_t len, int64_t offset, int bufIndex);
+
+    //检查固定缓冲区的范围 返回缓冲区里的地址
+    char* fixedAddress(int bufIndex, size_t bufOffset, size_t len) const;
+
+    //I/O完成 把结果交给Result 释放请求
+    void finish(Request* req, long res);
+
+    //在当前线程阻塞地执行请求 返回字节数或-errno
+    static long runSync(const Request* req);
+
+    //io_uring 创建失败时返回false 调用者改用I/O线程
+    bool setupUring(unsigned depth);
+    void closeUring();
+    void pushUring(Request* req);
+    void ReapFunc();
+
+    //I/O线程
+    void startThreads(int threads);
+    void IoThreadFunc();
+
+    ThreadPool& pool_;
+    IoBackend backend_;
+    std::atomic<size_t> inflight_{ 0 };
+    std::vector<iovec> buffers_; //登记的固定缓冲区
+    bool buffersRegistered_ = false; //固定缓冲区是否在内核里登记成功
+
+    //io_uring的环形队列 内核和用户态共享 提交队列由submitMtx_保护 完成队列只由收割线程访问
+    int ringFd_ = -1;
+    void* sqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    void* cqRing_ = nullptr;
+    size_t cqRingSize_ = 0;
+    void* sqes_ = nullptr;
+    size_t sqesSize_ = 0;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned* sqArray_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    void* cqes_ = nullptr;
+    size_t depth_ = 0; //同时提交的I/O上限 不超过提交队列的大小 完成队列不会溢出
+    std::mutex submitMtx_;
+    std::condition_variable notFull_; //在内核里的I/O少于depth_
+    std::thread reaper_; //收割完成队列的线程
+    std::atomic_bool exiting_{ false };
+
+    //I/O线程方式的请求队列
+    std::mutex queMtx_;
+    std::condition_variable queCond_;
+    std::deque<Request*> que_;
+    std::vector<std::thread> ioThreads_;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "logger.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+const size_t LOG_BUFFER_SIZE = 1024; //每个线程的缓冲区能放下的日志条数 必须是2的幂
+const int LOG_DRAIN_INTERVAL_MS = 10; //有日志时后台线程攒多久再输出 没有日志时后台线程一直睡眠
+
+//一条日志 只保存原始数据 不做格式化
+struct LogRecord
+{
+    long long timeNs_;
+    const char* msg_;
+    long long arg_;
+    LogLevel level_;
+    bool hasArg_;
+};
+
+//单个线程的日志缓冲区 写日志的线程是唯一的生产者 后台线程是唯一的消费者
+class LogBuffer
+{
+public:
+    LogBuffer()
+        : head_(0)
+        , tail_(0)
+        , dropped_(0)
+        , isDead_(false)
+    {
+        std::ostringstream os;
+        os << std::this_thread::get_id();
+        threadName_ = os.str();
+    }
+
+    //写入一条日志 缓冲区满返回false
+    bool push(const LogRecord& record)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= LOG_BUFFER_SIZE)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        records_[tail & (LOG_BUFFER_SIZE - 1)] = record;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //取出所有日志交给output输出 返回取出的条数
+    template<typename Output>
+    size_t drain(Output output)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t count = tail - head;
+        for (; head != tail; head++)
+        {
+            output(records_[head & (LOG_BUFFER_SIZE - 1)], threadName_);
+        }
+        head_.store(head, std::memory_order_release);
+        return count;
+    }
+
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    LogRecord records_[LOG_BUFFER_SIZE];
+    alignas(64) std::atomic<size_t> head_; //消费者位置
+    alignas(64) std::atomic<size_t> tail_; //生产者位置
+    std::atomic<size_t> dropped_;          //缓冲区满被丢弃的日志条数
+    std::atomic_bool isDead_;              //所属线程已经退出 取完日志后可以释放
+    std::string threadName_;
+};
+
+//管理所有线程的缓冲区和后台输出线程
+//对象故意不析构 线程池的分离线程在进程退出时可能还在写日志
+class LogCenter
+{
+public:
+    static LogCenter& instance()
+    {
+        static LogCenter* center = new LogCenter();
+        return *center;
+    }
+
+    //为当前线程创建缓冲区
+    std::shared_ptr<LogBuffer> registerThread()
+    {
+        auto buffer = std::make_shared<LogBuffer>();
+        std::lock_guard<std::mutex> guard(mtx_);
+        buffers_.push_back(buffer);
+        return buffer;
+    }
+
+    //取出所有缓冲区的日志并输出 同一时间只有一个消费者
+    void drainAll()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        std::ostringstream os;
+        for (auto it = buffers_.begin(); it != buffers_.end();)
+        {
+            LogBuffer* buffer = it->get();
+            size_t drained = buffer->drain([&](const LogRecord& record, const std::string& threadName) {
+                format(os, record, threadName);
+            });
+            pending_.fetch_sub((long long)drained);
+            size_t dropped = buffer->dropped_.exchange(0);
+            if (dropped > 0)
+            {
+                os << "[WARN] tid:" << buffer->threadName_ << " " << dropped << " log records dropped\n";
+            }
+            //线程退出并且日志取完了 释放缓冲区
+            if (buffer->isDead_ && buffer->empty())
+                it = buffers_.erase(it);
+            else
+                ++it;
+        }
+        std::string out = os.str();
+        if (!out.empty())
+        {
+            std::cerr << out << std::flush;
+        }
+    }
+
+    //写入一条日志后调用 之前没有待输出的日志时唤醒后台线程
+    void recordWritten()
+    {
+        if (pending_.fetch_add(1) == 0)
+        {
+            std::lock_guard<std::mutex> guard(waitMtx_);
+            waitCond_.notify_one();
+        }
+    }
+
+    long long nowNs() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - startTime_).count();
+    }
+
+private:
+    LogCenter()
+        : startTime_(std::chrono::steady_clock::now())
+    {
+        //没有日志时睡眠到第一条日志写入 之后攒一个间隔再输出 连续有日志时仍按间隔批量输出
+        std::thread t([this]() {
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(waitMtx_);
+                    waitCond_.wait(lock, [this]() { return pending_ > 0; });
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(LOG_DRAIN_INTERVAL_MS));
+                drainAll();
+            }
+        });
+        t.detach();
+        atexit([]() { LogCenter::instance().drainAll(); });
+    }
+
+    static void format(std::ostringstream& os, const LogRecord& record, const std::string& threadName)
+    {
+        static const char* levelNames[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+        os << "[" << levelNames[(int)record.level_] << "] "
+            << record.timeNs_ / 1000000 << "ms tid:" << threadName << " " << record.msg_;
+        if (record.hasArg_)
+        {
+            os << " " << record.arg_;
+        }
+        os << '\n';
+    }
+
+    std::mutex mtx_;
+    std::vector<std::shared_ptr<LogBuffer>> buffers_;
+    //写入还没输出的日志条数 取出日志的线程可能先于写日志的线程计数 短暂为负
+    std::atomic<long long> pending_{ 0 };
+    std::mutex waitMtx_;
+    std::condition_variable waitCond_; //后台线程等待第一条日志
+    std::chrono::steady_clock::time_point startTime_;
+};
+
+//线程退出时标记缓冲区 由后台线程取完日志后释放
+struct LocalLogBuffer
+{
+    std::shared_ptr<LogBuffer> buffer_;
+    ~LocalLogBuffer()
+    {
+        if (buffer_ != nullptr)
+            buffer_->isDead_ = true;
+    }
+};
+
+static LogBuffer* localBuffer()
+{
+    thread_local LocalLogBuffer local;
+    if (local.buffer_ == nullptr)
+    {
+        local.buffer_ = LogCenter::instance().registerThread();
+    }
+    return local.buffer_.get();
+}
+
+void Logger::write(LogLevel level, const char* msg)
+{
+    LogCenter& center = LogCenter::instance();
+    if (localBuffer()->push(LogRecord{ center.nowNs(), msg, 0, level, false }))
+        center.recordWritten();
+}
+
+void Logger::write(LogLevel level, const char* msg, long long arg)
+{
+    LogCenter& center = LogCenter::instance();
+    if (localBuffer()->push(LogRecord{ center.nowNs(), msg, arg, level, true }))
+        center.recordWritten();
+}
+
+void Logger::flush()
+{
+    LogCenter::instance().drainAll();
+}
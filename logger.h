@@ -0,0 +1,57 @@
+/*线程池内部日志 级别在编译时选择 低于该级别的日志调用整个被编译掉*/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+//编译时通过 -DTHREADPOOL_LOG_LEVEL=n 选择输出的最低级别
+//0:DEBUG 1:INFO 2:WARN 3:ERROR 4:关闭全部日志
+#ifndef THREADPOOL_LOG_LEVEL
+#define THREADPOOL_LOG_LEVEL 2
+#endif
+
+enum class LogLevel
+{
+    LEVEL_DEBUG,
+    LEVEL_INFO,
+    LEVEL_WARN,
+    LEVEL_ERROR,
+};
+
+//异步日志：每个线程写自己的无锁环形缓冲区(单生产者单消费者) 后台线程取出并输出到stderr 没有日志时后台线程不醒来
+//写日志只记录时间、级别、字符串常量的地址和一个整数参数 格式化和输出都在后台线程完成
+//所以msg必须是字符串常量 缓冲区满时丢弃日志并计数 不阻塞写日志的线程
+class Logger
+{
+public:
+    static void write(LogLevel level, const char* msg);
+    static void write(LogLevel level, const char* msg, long long arg);
+
+    //把所有缓冲区里的日志立即输出 进程退出时会自动调用
+    static void flush();
+};
+
+#if THREADPOOL_LOG_LEVEL <= 0
+#define POOL_LOG_DEBUG(...) Logger::write(LogLevel::LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define POOL_LOG_DEBUG(...) ((void)0)
+#endif
+
+#if THREADPOOL_LOG_LEVEL <= 1
+#define POOL_LOG_INFO(...) Logger::write(LogLevel::LEVEL_INFO, __VA_ARGS__)
+#else
+#define POOL_LOG_INFO(...) ((void)0)
+#endif
+
+#if THREADPOOL_LOG_LEVEL <= 2
+#define POOL_LOG_WARN(...) Logger::write(LogLevel::LEVEL_WARN, __VA_ARGS__)
+#else
+#define POOL_LOG_WARN(...) ((void)0)
+#endif
+
+#if THREADPOOL_LOG_LEVEL <= 3
+#define POOL_LOG_ERROR(...) Logger::write(LogLevel::LEVEL_ERROR, __VA_ARGS__)
+#else
+#define POOL_LOG_ERROR(...) ((void)0)
+#endif
+
+#endif
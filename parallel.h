@@ -0,0 +1,273 @@
+/*基于线程池的并行算法 parallel_for / parallel_reduce / parallel_transform*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <exception>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "threadpool.h"
+#include "ringqueue.h" //CACHE_LINE_SIZE
+
+/*
+代替手动把[begin,end]切成固定几段、每段一个Task、再逐个Result求和的写法
+区间按需二分(lazy binary splitting)：调用线程先拿到整个区间 每执行完一小块检查线程池
+有空闲线程时把剩下的后一半拆成新任务交给线程池 没有空闲线程就继续自己执行
+所以拆分次数随空闲线程数量自适应 负载不均时也能被其他线程分走
+
+example:
+parallel_for(pool, 0, n, [&](size_t i) { out[i] = in[i] * 2; });
+parallel_for(pool, 0, n, [&](size_t b, size_t e) { for (size_t i = b; i < e; i++) ... }); //整块处理 便于向量化
+uLong sum = parallel_reduce(pool, 1, 100000001, uLong(0),
+    [](size_t i) { return uLong(i); }, [](uLong a, uLong b) { return a + b; });
+parallel_transform(pool, in.begin(), in.end(), out.begin(), [](int x) { return x * 2; });
+*/
+
+//并行算法的拆分参数
+struct ParallelOptions
+{
+    size_t grain = 0; //每次连续执行的元素数量 也是两次检查是否拆分之间的工作量 0表示自动
+    size_t align = 0; //拆分点对齐到align个元素 写连续数组时取一个缓存行放得下的元素个数 两个线程不会写同一个缓存行
+                      //0表示自动：parallel_transform按输出元素大小对齐 其他算法不对齐
+};
+
+//一次并行调用的共享状态 放在调用线程的栈上 调用线程等所有拆出去的任务结束后才返回
+//Acc是每个任务自己的部分结果 body(b, e, acc)处理一段区间 combine(acc)合并一个任务的部分结果
+template<typename Acc, typename Body, typename Combine>
+class ParallelJob
+{
+public:
+    ParallelJob(ThreadPool& pool, const Acc& identity, Body& body, Combine& combine,
+        size_t grain, size_t align, size_t phase)
+        : pool_(pool)
+        , identity_(identity)
+        , body_(body)
+        , combine_(combine)
+        , grain_(grain)
+        , align_(align)
+        , phase_(phase)
+        , pending_(1)
+        , failed_(false)
+    {}
+    ParallelJob(const ParallelJob&) = delete;
+    ParallelJob& operator=(const ParallelJob&) = delete;
+
+    //第一段在调用线程上执行 然后等待拆出去的任务 有任务抛出异常时重新抛出第一个异常
+    //调用线程是线程池的工作线程时(嵌套的并行调用) 等待期间执行排队的任务 包括自己拆出去的
+    void run(size_t first, size_t last)
+    {
+        execute(first, last);
+        finish();
+        helpWait(done_);
+        if (error_)
+        {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    //执行[b, e) 每执行完一块检查是否有空闲线程 有就把剩下的后一半拆给线程池
+    void execute(size_t b, size_t e)
+    {
+        Acc acc = identity_;
+        try
+        {
+            while (e - b > grain_ && !failed_)
+            {
+                if (pool_.hasIdleThread())
+                {
+                    size_t mid = splitPoint(b, e);
+                    if (mid < e)
+                    {
+                        spawn(mid, e);
+                        e = mid;
+                        continue;
+                    }
+                }
+                body_(b, b + grain_, acc);
+                b += grain_;
+            }
+            if (!failed_)
+            {
+                body_(b, e, acc);
+                combine_(acc);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(errorMtx_);
+            if (!error_)
+                error_ = std::current_exception();
+            failed_ = true;
+        }
+    }
+
+    //区间中点 按align对齐 对齐后不在(b, e)内时返回e表示不拆分
+    size_t splitPoint(size_t b, size_t e) const
+    {
+        size_t mid = b + (e - b) / 2;
+        if (align_ > 1)
+        {
+            size_t aligned = (mid + phase_) / align_ * align_;
+            if (aligned <= b + phase_)
+                return e;
+            mid = aligned - phase_;
+        }
+        return mid;
+    }
+
+    //把[b, e)交给线程池 队列满提交失败时在当前线程执行
+    void spawn(size_t b, size_t e)
+    {
+        pending_++;
+        auto call = [this, b, e]() {
+            execute(b, e);
+            finish();
+        };
+        auto task = allocateShared<FuncTask<void, decltype(call)>>(std::move(call));
+        if (!pool_.trySubmitTask(task).valid())
+        {
+            task->exec();
+        }
+    }
+
+    void finish()
+    {
+        if (pending_.fetch_sub(1) == 1)
+        {
+            done_.set();
+        }
+    }
+
+    ThreadPool& pool_;
+    const Acc& identity_;
+    Body& body_;
+    Combine& combine_;
+    size_t grain_;
+    size_t align_;
+    size_t phase_; //区间起点在缓存行里的偏移(元素个数) 拆分点加上它之后对齐
+
+    std::atomic<size_t> pending_; //还没结束的任务数量 调用线程自己算一个
+    Completion done_;
+    std::atomic_bool failed_;     //有任务抛出异常 剩下的区间不再执行
+    std::mutex errorMtx_;
+    std::exception_ptr error_;
+};
+
+//parallel_for没有部分结果
+struct ParallelNoAcc
+{};
+
+//根据元素数量确定每块的大小 自动时大约每个硬件线程分到64块 并且是align的整数倍
+inline size_t parallelGrain(size_t count, const ParallelOptions& options, size_t align)
+{
+    size_t grain = options.grain;
+    if (grain == 0)
+    {
+        size_t threads = std::thread::hardware_concurrency();
+        grain = count / ((threads == 0 ? 1 : threads) * 64);
+    }
+    if (grain < 1)
+        grain = 1;
+    if (align > 1)
+        grain = (grain + align - 1) / align * align;
+    return grain;
+}
+
+//并行执行func(i) i属于[first, last) 或者按块执行func(b, e)
+template<typename Func>
+void parallel_for(ThreadPool& pool, size_t first, size_t last, Func&& func, ParallelOptions options = ParallelOptions())
+{
+    if (first >= last)
+        return;
+    size_t align = options.align == 0 ? 1 : options.align;
+    auto body = [&func](size_t b, size_t e, ParallelNoAcc&) {
+        if constexpr (std::is_invocable<Func&, size_t, size_t>::value)
+        {
+            func(b, e);
+        }
+        else
+        {
+            for (size_t i = b; i < e; i++)
+                func(i);
+        }
+    };
+    auto combine = [](ParallelNoAcc&) {};
+    ParallelNoAcc identity;
+    ParallelJob<ParallelNoAcc, decltype(body), decltype(combine)> job(pool, identity, body, combine,
+        parallelGrain(last - first, options, align), align, 0);
+    job.run(first, last);
+}
+
+//并行归约 每个任务在自己的部分结果上累加reduce(acc, func(i)) 或者按块acc = reduce(acc, func(b, e))
+//任务结束时用reduce把部分结果合并到总结果 reduce要满足结合律 identity是reduce的单位元
+//部分结果合并的顺序不固定 浮点数求和的结果可能有微小差别
+template<typename T, typename Func, typename Reduce>
+T parallel_reduce(ThreadPool& pool, size_t first, size_t last, T identity, Func&& func, Reduce&& reduce,
+    ParallelOptions options = ParallelOptions())
+{
+    if (first >= last)
+        return identity;
+    size_t align = options.align == 0 ? 1 : options.align;
+    T total = identity;
+    std::mutex totalMtx;
+    auto body = [&func, &reduce](size_t b, size_t e, T& acc) {
+        if constexpr (std::is_invocable<Func&, size_t, size_t>::value)
+        {
+            acc = reduce(std::move(acc), func(b, e));
+        }
+        else
+        {
+            for (size_t i = b; i < e; i++)
+                acc = reduce(std::move(acc), func(i));
+        }
+    };
+    auto combine = [&](T& acc) {
+        std::lock_guard<std::mutex> guard(totalMtx);
+        total = reduce(std::move(total), std::move(acc));
+    };
+    ParallelJob<T, decltype(body), decltype(combine)> job(pool, identity, body, combine,
+        parallelGrain(last - first, options, align), align, 0);
+    job.run(first, last);
+    return total;
+}
+
+//并行变换 *(out + i) = func(*(first + i)) 迭代器需要支持随机访问
+//自动对齐时拆分点对齐到输出的缓存行 相邻两块的输出不会落在同一个缓存行
+template<typename InIt, typename OutIt, typename Func>
+OutIt parallel_transform(ThreadPool& pool, InIt first, InIt last, OutIt out, Func&& func,
+    ParallelOptions options = ParallelOptions())
+{
+    size_t count = (size_t)std::distance(first, last);
+    if (count == 0)
+        return out;
+
+    using OutValue = typename std::remove_reference<decltype(*out)>::type;
+    size_t align = options.align;
+    if (align == 0)
+        align = sizeof(OutValue) < CACHE_LINE_SIZE ? CACHE_LINE_SIZE / sizeof(OutValue) : 1;
+    //输出数组起点不一定在缓存行边界上 算出起点在缓存行里的偏移 拆分点按输出的地址对齐
+    size_t phase = (size_t)((uintptr_t)std::addressof(*out) % CACHE_LINE_SIZE) / sizeof(OutValue);
+
+    auto body = [&](size_t b, size_t e, ParallelNoAcc&) {
+        InIt in = first + b;
+        OutIt dst = out + b;
+        for (size_t i = b; i < e; i++, ++in, ++dst)
+            *dst = func(*in);
+    };
+    auto combine = [](ParallelNoAcc&) {};
+    ParallelNoAcc identity;
+    ParallelJob<ParallelNoAcc, decltype(body), decltype(combine)> job(pool, identity, body, combine,
+        parallelGrain(count, options, align), align, phase % align);
+    job.run(0, count);
+    return out + count;
+}
+
+#endif
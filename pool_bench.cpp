@@ -0,0 +1,827 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+#include "ioengine.h"
+#include "taskgroup.h"
+#include "taskbatcher.h"
+#include "basicpool.h"
+
+/*
+线程池性能测试 每个测试场景输出一行 方便在同一台机器上对比不同版本
+用法: pool_bench [--json] [--quick] [--threads N]
+    --json     每行输出一个JSON对象 默认输出CSV
+    --quick    减少任务数量 用于快速检查
+    --threads  工作线程数量 默认hardware_concurrency
+*/
+
+using Clock = std::chrono::steady_clock;
+
+//替换全局operator new 统计测试期间的堆分配次数 线程池库里的分配也会被统计
+static std::atomic<unsigned long long> allocCount(0);
+
+//new和delete都替换成了malloc/free 是配对的 GCC内联之后仍按内置的operator new判断为不匹配 局部关闭这个警告
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, std::max((size_t)align, sizeof(void*)), size == 0 ? 1 : size) != 0)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+    free(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+//线程池配置：工作模式 + 任务队列实现
+struct PoolConfig
+{
+    const char* name;
+    PoolMode mode;
+    TaskQueMode queMode;
+};
+
+static const PoolConfig configs[] = {
+    { "fixed-locked",      PoolMode::MODE_FIXED,    TaskQueMode::QUE_LOCKED },
+    { "fixed-lockfree",    PoolMode::MODE_FIXED,    TaskQueMode::QUE_LOCKFREE },
+    { "cached-locked",     PoolMode::MODE_CACHED,   TaskQueMode::QUE_LOCKED },
+    { "stealing-locked",   PoolMode::MODE_STEALING, TaskQueMode::QUE_LOCKED },
+    { "stealing-lockfree", PoolMode::MODE_STEALING, TaskQueMode::QUE_LOCKFREE },
+};
+
+//一次测试的结果
+struct BenchRecord
+{
+    std::string bench;
+    std::string config;
+    int threads = 0;
+    int producers = 1;
+    long long taskNs = 0;     //每个任务的工作量
+    long long tasks = 0;      //提交的任务数量
+    double seconds = 0;
+    long long p50Ns = 0;      //提交到开始执行的延迟
+    long long p99Ns = 0;
+    long long maxNs = 0;
+    unsigned long long rejected = 0;
+    unsigned long long threadsCreated = 0;
+    unsigned long long allocs = 0; //计时期间的堆分配次数
+};
+
+static bool jsonOutput = false;
+
+static void printHeader()
+{
+    if (!jsonOutput)
+    {
+        std::cout << "bench,config,threads,producers,task_ns,tasks,seconds,tasks_per_sec,"
+            "wait_p50_ns,wait_p99_ns,wait_max_ns,rejected,threads_created,allocs" << std::endl;
+    }
+}
+
+static void printRecord(const BenchRecord& r)
+{
+    double rate = r.seconds > 0 ? r.tasks / r.seconds : 0;
+    if (jsonOutput)
+    {
+        std::cout << "{\"bench\":\"" << r.bench << "\",\"config\":\"" << r.config
+            << "\",\"threads\":" << r.threads << ",\"producers\":" << r.producers
+            << ",\"task_ns\":" << r.taskNs << ",\"tasks\":" << r.tasks
+            << ",\"seconds\":" << r.seconds << ",\"tasks_per_sec\":" << (long long)rate
+            << ",\"wait_p50_ns\":" << r.p50Ns << ",\"wait_p99_ns\":" << r.p99Ns
+            << ",\"wait_max_ns\":" << r.maxNs << ",\"rejected\":" << r.rejected
+            << ",\"threads_created\":" << r.threadsCreated << ",\"allocs\":" << r.allocs << "}" << std::endl;
+    }
+    else
+    {
+        std::cout << r.bench << "," << r.config << "," << r.threads << "," << r.producers << ","
+            << r.taskNs << "," << r.tasks << "," << r.seconds << "," << (long long)rate << ","
+            << r.p50Ns << "," << r.p99Ns << "," << r.maxNs << "," << r.rejected << ","
+            << r.threadsCreated << "," << r.allocs << std::endl;
+    }
+}
+
+//忙等一段时间 模拟指定粒度的任务
+static void spinFor(long long ns)
+{
+    if (ns <= 0)
+        return;
+    auto end = Clock::now() + std::chrono::nanoseconds(ns);
+    while (Clock::now() < end)
+    {
+    }
+}
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+//创建并启动线程池 开启任务计时统计提交到开始执行的延迟
+static void startPool(ThreadPool& pool, const PoolConfig& config, int threads, int queThreshHold = 1 << 16)
+{
+    pool.setMode(config.mode);
+    pool.settaskQueMode(config.queMode);
+    pool.settaskQueMaxThreshHold(queThreshHold);
+    pool.setthreadSizeThreshHold(threads * 4);//cached模式最多扩展到4倍线程
+    pool.setTaskTiming(true);
+    pool.start(threads);
+}
+
+//从线程池统计里取出延迟和计数
+static void fillStats(BenchRecord& r, const ThreadPool& pool)
+{
+    PoolStats st = pool.stats();
+    r.p50Ns = (long long)st.queueWait.percentile(50);
+    r.p99Ns = (long long)st.queueWait.percentile(99);
+    r.maxNs = (long long)st.queueWait.max();
+    r.rejected = st.rejected;
+    r.threadsCreated = st.threadsCreated;
+}
+
+//1.提交吞吐量：一个提交者连续提交指定粒度的任务 等待全部执行完
+static void benchThroughput(const PoolConfig& config, int threads, long long taskNs, long long tasks)
+{
+    BenchRecord r;
+    r.bench = "throughput";
+    r.config = config.name;
+    r.threads = threads;
+    r.taskNs = taskNs;
+    r.tasks = tasks;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        std::vector<Result<void>> results;
+        results.reserve(tasks);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (long long i = 0; i < tasks; i++)
+        {
+            results.push_back(pool.submit([taskNs]() { spinFor(taskNs); }));
+        }
+        for (auto& res : results)
+            res.wait();
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        fillStats(r, pool);
+    }
+    printRecord(r);
+}
+
+//2.提交到开始执行的延迟：逐个提交并等待完成 线程池大部分时间是空闲的
+static void benchLatency(const PoolConfig& config, int threads, long long tasks)
+{
+    BenchRecord r;
+    r.bench = "latency";
+    r.config = config.name;
+    r.threads = threads;
+    r.tasks = tasks;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (long long i = 0; i < tasks; i++)
+        {
+            pool.submit([]() {}).wait();
+        }
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        fillStats(r, pool);
+    }
+    printRecord(r);
+}
+
+//3.扇出扇入：把一个计算拆成N个任务 合并N个Result
+static void benchFanOut(const PoolConfig& config, int threads, long long fanOut, int rounds)
+{
+    BenchRecord r;
+    r.bench = "fanout";
+    r.config = config.name;
+    r.threads = threads;
+    r.tasks = fanOut * rounds;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        unsigned long long total = 0;
+        for (int round = 0; round < rounds; round++)
+        {
+            std::vector<Result<unsigned long long>> parts;
+            parts.reserve(fanOut);
+            for (long long i = 0; i < fanOut; i++)
+            {
+                parts.push_back(pool.submit([i]() {
+                    unsigned long long sum = 0;
+                    for (long long k = i * 1000; k < (i + 1) * 1000; k++)
+                        sum += k;
+                    return sum;
+                }));
+            }
+            for (auto& part : parts)
+                total += part.get();
+        }
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        fillStats(r, pool);
+        if (total == 0)
+            std::cerr << "unexpected fan-out result" << std::endl;
+    }
+    printRecord(r);
+}
+
+//4.多生产者竞争：多个线程同时提交空任务
+static void benchProducers(const PoolConfig& config, int threads, int producers, long long tasksPerProducer)
+{
+    BenchRecord r;
+    r.bench = "producers";
+    r.config = config.name;
+    r.threads = threads;
+    r.producers = producers;
+    r.tasks = tasksPerProducer * producers;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        std::atomic_llong done(0);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        std::vector<std::thread> submitters;
+        for (int p = 0; p < producers; p++)
+        {
+            submitters.emplace_back([&]() {
+                std::vector<Result<void>> results;
+                results.reserve(tasksPerProducer);
+                for (long long i = 0; i < tasksPerProducer; i++)
+                    results.push_back(pool.submit([&done]() { done++; }));
+                for (auto& res : results)
+                    res.wait();
+            });
+        }
+        for (auto& t : submitters)
+            t.join();
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        fillStats(r, pool);
+    }
+    printRecord(r);
+}
+
+//5.突发负载：若干批任务之间有空闲间隔 比较fixed和cached模式
+static void benchBursty(const PoolConfig& config, int threads, int bursts, long long burstSize, long long taskNs)
+{
+    BenchRecord r;
+    r.bench = "bursty";
+    r.config = config.name;
+    r.threads = threads;
+    r.taskNs = taskNs;
+    r.tasks = bursts * burstSize;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (int b = 0; b < bursts; b++)
+        {
+            std::vector<Result<void>> results;
+            results.reserve(burstSize);
+            for (long long i = 0; i < burstSize; i++)
+                results.push_back(pool.submit([taskNs]() { spinFor(taskNs); }));
+            for (auto& res : results)
+                res.wait();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        fillStats(r, pool);
+    }
+    printRecord(r);
+}
+
+//6.队列满时的反压：队列上限很小 任务较慢 统计提交被阻塞的总时间和失败数量
+static void benchBackPressure(const PoolConfig& config, int threads, long long tasks, long long taskNs)
+{
+    BenchRecord r;
+    r.bench = "backpressure";
+    r.config = config.name;
+    r.threads = threads;
+    r.taskNs = taskNs;
+    r.tasks = tasks;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads, 16);
+        std::vector<Result<void>> results;
+        results.reserve(tasks);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (long long i = 0; i < tasks; i++)
+            results.push_back(pool.submit([taskNs]() { spinFor(taskNs); }));
+        for (auto& res : results)
+            res.wait();
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        fillStats(r, pool);
+    }
+    printRecord(r);
+}
+
+//7.过载时的拒绝策略：提交速度远超处理能力 比较各策略下提交方花的时间、任务排队延迟和拒绝数量
+static void benchOverload(const PoolConfig& config, int threads, RejectPolicy policy, const char* policyName,
+    long long tasks, long long taskNs)
+{
+    BenchRecord r;
+    r.bench = "overload";
+    r.config = std::string(config.name) + "/" + policyName;
+    r.threads = threads;
+    r.taskNs = taskNs;
+    r.tasks = tasks;
+    {
+        ThreadPool pool;
+        pool.setRejectPolicy(policy, std::chrono::milliseconds(1));
+        startPool(pool, config, threads, 16);
+        std::vector<Result<void>> results;
+        results.reserve(tasks);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (long long i = 0; i < tasks; i++)
+            results.push_back(pool.submit([taskNs]() { spinFor(taskNs); }));
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        for (auto& res : results)
+            res.wait();
+        fillStats(r, pool);
+        PoolStats st = pool.stats();
+        r.rejected = st.rejected + st.dropped;
+    }
+    printRecord(r);
+}
+
+//8.稳定状态的堆分配：先跑一轮让线程的空闲链表和队列节点就绪 再统计第二轮每个任务的分配次数
+//submit的任务对象和返回值、队列节点、后续回调都从PoolArena分配 稳定状态下应该是0
+static void benchSteadyAllocs(const PoolConfig& config, int threads, long long tasks)
+{
+    BenchRecord r;
+    r.bench = "steady_allocs";
+    r.config = config.name;
+    r.threads = threads;
+    r.tasks = tasks;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        std::vector<Result<long long>> results;
+        results.reserve(tasks);
+        for (int round = 0; round < 2; round++)
+        {
+            results.clear();
+            unsigned long long allocs = allocCount.load();
+            auto start = Clock::now();
+            for (long long i = 0; i < tasks; i++)
+                results.push_back(pool.submit([i]() { return i; }));
+            long long sum = 0;
+            for (auto& res : results)
+                sum += res.get();
+            r.seconds = secondsSince(start);
+            r.allocs = allocCount.load() - allocs;
+            if (sum != tasks * (tasks - 1) / 2)
+                std::cerr << "unexpected steady result" << std::endl;
+        }
+        fillStats(r, pool);
+    }
+    printRecord(r);
+}
+
+//大量定时器：提交者在100毫秒内安排tasks个一次性定时器 再取消一半(模拟超时在到期前被取消)
+//seconds只统计安排和取消花的时间 延迟列是定时器实际执行时间比到期时间晚了多少
+static void benchTimers(const PoolConfig& config, int threads, long long tasks)
+{
+    BenchRecord r;
+    r.bench = "timers";
+    r.config = config.name;
+    r.threads = threads;
+    r.tasks = tasks;
+    //回调在工作线程上写入 先于线程池声明 线程池析构、所有回调结束后才读取
+    std::vector<long long> lateness(tasks);
+    std::atomic<long long> fired(0);
+    std::atomic<long long> recorded(0);
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        std::vector<TimerId> ids;
+        ids.reserve(tasks);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (long long i = 0; i < tasks; i++)
+        {
+            auto due = start + std::chrono::microseconds(20000 + i * 100000 / tasks);
+            ids.push_back(pool.scheduleAt(due, [&lateness, &fired, &recorded, due]() {
+                //取消得太晚时执行的定时器可能多于一半
+                long long slot = fired.fetch_add(1);
+                if (slot < (long long)lateness.size())
+                    lateness[slot] = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - due).count();
+                recorded++;
+            }));
+        }
+        for (long long i = 0; i < tasks; i += 2)
+            pool.cancelTimer(ids[i]);
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+
+        while (recorded < tasks / 2)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        r.rejected = pool.stats().rejected;
+    }
+    lateness.resize(std::min<long long>(fired, tasks));
+    if (!lateness.empty())
+    {
+        std::sort(lateness.begin(), lateness.end());
+        r.p50Ns = lateness[lateness.size() / 2];
+        r.p99Ns = lateness[lateness.size() * 99 / 100];
+        r.maxNs = lateness.back();
+    }
+    printRecord(r);
+}
+
+//部分任务阻塞：先提交threads个阻塞20毫秒的任务占住所有线程 再提交CPU任务
+//scope为true时阻塞的任务用BlockingScope标记 线程池启用补偿线程执行CPU任务 seconds是CPU任务全部完成的时间
+static void benchBlocking(const PoolConfig& config, int threads, bool scope, long long tasks, long long taskNs)
+{
+    BenchRecord r;
+    r.bench = "blocking";
+    r.config = std::string(config.name) + (scope ? "/scope" : "/raw");
+    r.threads = threads;
+    r.taskNs = taskNs;
+    r.tasks = tasks;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        std::vector<Result<void>> blockers;
+        for (int i = 0; i < threads; i++)
+        {
+            blockers.push_back(pool.submit([scope]() {
+                if (scope)
+                {
+                    BlockingScope blocking;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                }
+                else
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                }
+            }));
+        }
+        std::vector<Result<void>> results;
+        results.reserve(tasks);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (long long i = 0; i < tasks; i++)
+            results.push_back(pool.submit([taskNs]() { spinFor(taskNs); }));
+        for (auto& res : results)
+            res.wait();
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        for (auto& res : blockers)
+            res.wait();
+        fillStats(r, pool);
+    }
+    printRecord(r);
+}
+
+static long long fibValue(int n)
+{
+    long long a = 0, b = 1;
+    for (int i = 0; i < n; i++)
+    {
+        long long c = a + b;
+        a = b;
+        b = c;
+    }
+    return a;
+}
+
+//递归分治 任务在工作线程上提交子任务并等待结果 等待的线程执行排队的任务 线程数量再少也不会死锁
+static long long forkJoinFib(ThreadPool& pool, int n)
+{
+    if (n < 12)
+        return fibValue(n);
+    Result<long long> left = pool.submit(forkJoinFib, std::ref(pool), n - 1);
+    long long right = forkJoinFib(pool, n - 2);
+    return left.get() + right;
+}
+
+static void benchForkJoin(const PoolConfig& config, int threads, int n)
+{
+    BenchRecord r;
+    r.bench = "forkjoin";
+    r.config = config.name;
+    r.threads = threads;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        long long value = pool.submit(forkJoinFib, std::ref(pool), n).get();
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        if (value != fibValue(n))
+            std::cerr << "unexpected fib result" << std::endl;
+        fillStats(r, pool);
+        r.tasks = (long long)pool.stats().submitted;
+    }
+    printRecord(r);
+}
+
+//分块读一个临时文件并统计每块的换行数 比较工作线程里直接pread和交给IoEngine两种方式
+//文件刚写完在页缓存里 测的是提交和完成通知的开销
+static void benchFileRead(const PoolConfig& config, int threads, const char* mode, long long blocks)
+{
+    const size_t blockSize = 64 * 1024;
+    char path[] = "/tmp/pool_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        std::cerr << "create temp file fail" << std::endl;
+        return;
+    }
+    unlink(path);
+    std::vector<char> block(blockSize, 'x');
+    for (size_t i = 0; i < blockSize; i += 128)
+        block[i] = '\n';
+    for (long long i = 0; i < blocks; i++)
+    {
+        if (pwrite(fd, block.data(), blockSize, (off_t)(i * blockSize)) != (ssize_t)blockSize)
+        {
+            std::cerr << "write temp file fail" << std::endl;
+            close(fd);
+            return;
+        }
+    }
+
+    BenchRecord r;
+    r.bench = "fileread";
+    r.config = std::string(config.name) + "/" + mode;
+    r.threads = threads;
+    r.tasks = blocks;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        std::vector<char> buffer(blocks * blockSize);
+        std::vector<Result<size_t>> results;
+        results.reserve(blocks);
+        auto countLines = [](const char* data, long n) {
+            return n < 0 ? (size_t)0 : (size_t)std::count(data, data + n, '\n');
+        };
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        if (strcmp(mode, "pread") == 0)
+        {
+            for (long long i = 0; i < blocks; i++)
+            {
+                char* data = buffer.data() + i * blockSize;
+                results.push_back(pool.submit([fd, data, i, blockSize, countLines]() {
+                    return countLines(data, (long)pread(fd, data, blockSize, (off_t)(i * blockSize)));
+                }));
+            }
+            for (auto& res : results)
+                res.get();
+        }
+        else
+        {
+            IoEngine io(pool, 256, strcmp(mode, "uring") == 0 ? IoBackend::IO_URING : IoBackend::IO_THREADS);
+            for (long long i = 0; i < blocks; i++)
+            {
+                char* data = buffer.data() + i * blockSize;
+                results.push_back(io.read(fd, data, blockSize, (int64_t)(i * blockSize)).then([data, countLines](long n) {
+                    return countLines(data, n);
+                }));
+            }
+            for (auto& res : results)
+                res.get();
+        }
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        fillStats(r, pool);
+    }
+    close(fd);
+    printRecord(r);
+}
+
+//两个任务组 权重1和3 低权重的组先积压大量任务 高权重的组随后提交
+//延迟一列是高权重组的任务在组队列里的等待时间 直接提交到线程池时要等低权重组的任务全部执行完
+static void benchGroups(const PoolConfig& config, int threads, long long tasks, long long taskNs)
+{
+    BenchRecord r;
+    r.bench = "groups";
+    r.config = config.name;
+    r.threads = threads;
+    r.taskNs = taskNs;
+    r.tasks = 2 * tasks;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        TaskGroup low(pool, 1);
+        TaskGroup high(pool, 3);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (long long i = 0; i < tasks; i++)
+            low.submit([taskNs]() { spinFor(taskNs); });
+        for (long long i = 0; i < tasks; i++)
+            high.submit([taskNs]() { spinFor(taskNs); });
+        high.wait();
+        low.wait();
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        fillStats(r, pool);
+        TaskGroupStats stats = high.stats();
+        r.p50Ns = (long long)stats.queueWait.percentile(50);
+        r.p99Ns = (long long)stats.queueWait.percentile(99);
+        r.maxNs = (long long)stats.queueWait.max();
+    }
+    printRecord(r);
+}
+
+//小任务攒批 和throughput同样粒度的任务经TaskBatcher每batch个提交一次 batch为1时等同于逐个提交
+static void benchBatched(const PoolConfig& config, int threads, long long taskNs, size_t batch, long long tasks)
+{
+    BenchRecord r;
+    r.bench = "batched_" + std::to_string(batch);
+    r.config = config.name;
+    r.threads = threads;
+    r.taskNs = taskNs;
+    r.tasks = tasks;
+    {
+        ThreadPool pool;
+        startPool(pool, config, threads);
+        TaskBatcher batcher(pool, batch, std::chrono::microseconds(0));
+        std::vector<Result<void>> results;
+        results.reserve(tasks);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (long long i = 0; i < tasks; i++)
+        {
+            results.push_back(batcher.submit([taskNs]() { spinFor(taskNs); }));
+        }
+        batcher.flush();
+        for (auto& res : results)
+            res.wait();
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+        fillStats(r, pool);
+    }
+    printRecord(r);
+}
+
+//编译期组合的线程池 和throughput同样的提交方式 只统计吞吐量和分配次数
+template<typename Pool>
+static void benchPolicy(const char* name, int threads, long long taskNs, long long tasks)
+{
+    BenchRecord r;
+    r.bench = "policy";
+    r.config = name;
+    r.threads = threads;
+    r.taskNs = taskNs;
+    r.tasks = tasks;
+    {
+        Pool pool;
+        pool.start(threads);
+        std::vector<Result<void>> results;
+        results.reserve(tasks);
+        unsigned long long allocs = allocCount.load();
+        auto start = Clock::now();
+        for (long long i = 0; i < tasks; i++)
+        {
+            results.push_back(pool.submit([taskNs]() { spinFor(taskNs); }));
+        }
+        for (auto& res : results)
+            res.wait();
+        r.seconds = secondsSince(start);
+        r.allocs = allocCount.load() - allocs;
+    }
+    printRecord(r);
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = false;
+    int threads = (int)std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            jsonOutput = true;
+        else if (strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+    }
+    if (threads <= 0)
+        threads = 1;
+    long long scale = quick ? 1 : 10;
+
+    printHeader();
+    for (const PoolConfig& config : configs)
+    {
+        //不同粒度的任务：空任务 1微秒 10微秒
+        for (long long taskNs : { 0LL, 1000LL, 10000LL })
+            benchThroughput(config, threads, taskNs, 10000 * scale / (taskNs >= 10000 ? 10 : 1));
+        benchLatency(config, threads, 1000 * scale);
+        benchFanOut(config, threads, 64, (int)(10 * scale));
+        benchProducers(config, threads, 4, 2500 * scale);
+        benchBackPressure(config, threads, 200 * scale, 20000);
+    }
+    //突发负载只比较fixed和cached
+    benchBursty(configs[0], threads, 5, 500 * scale, 20000);
+    benchBursty(configs[2], threads, 5, 500 * scale, 20000);
+    //过载时的拒绝策略 seconds只统计提交方花的时间 被淘汰的任务也计入rejected
+    benchOverload(configs[0], threads, RejectPolicy::REJECT_BLOCK, "block", 200 * scale, 20000);
+    benchOverload(configs[0], threads, RejectPolicy::REJECT_ABORT, "abort", 200 * scale, 20000);
+    benchOverload(configs[0], threads, RejectPolicy::REJECT_CALLER_RUNS, "caller_runs", 200 * scale, 20000);
+    benchOverload(configs[0], threads, RejectPolicy::REJECT_DISCARD_OLDEST, "discard_oldest", 200 * scale, 20000);
+    for (const PoolConfig& config : configs)
+        benchSteadyAllocs(config, threads, 10000 * scale);
+    //阻塞的任务 有没有BlockingScope标记
+    benchBlocking(configs[0], threads, false, 100 * scale, 10000);
+    benchBlocking(configs[0], threads, true, 100 * scale, 10000);
+    //定时器 只比较fixed和stealing
+    benchTimers(configs[0], threads, 20000 * scale);
+    benchTimers(configs[3], threads, 20000 * scale);
+    //递归分治 工作线程在任务里等待子任务的结果
+    for (const PoolConfig& config : configs)
+        benchForkJoin(config, threads, quick ? 22 : 27);
+    //任务组 两个租户同时积压
+    benchGroups(configs[0], threads, 2000 * scale, 10000);
+    benchGroups(configs[3], threads, 2000 * scale, 10000);
+    //小任务攒批 空任务和1微秒的任务
+    for (long long taskNs : { 0LL, 1000LL })
+    {
+        for (size_t batch : { (size_t)1, (size_t)16, (size_t)64 })
+        {
+            benchBatched(configs[0], threads, taskNs, batch, 10000 * scale);
+            benchBatched(configs[3], threads, taskNs, batch, 10000 * scale);
+        }
+    }
+    //编译期组合的线程池 与throughput的fixed-locked、fixed-lockfree对比
+    for (long long taskNs : { 0LL, 1000LL })
+    {
+        benchPolicy<BasicThreadPool<LockedQueue, BlockIdle, FixedSize, NoInstrumentation>>(
+            "locked-block-fixed", threads, taskNs, 10000 * scale);
+        benchPolicy<BasicThreadPool<LockFreeQueue, SpinIdle, FixedSize, NoInstrumentation>>(
+            "lockfree-spin-fixed", threads, taskNs, 10000 * scale);
+        benchPolicy<BasicThreadPool<LockFreeQueue, BlockIdle, GrowOnDemand, CountingInstrumentation>>(
+            "lockfree-block-grow", threads, taskNs, 10000 * scale);
+    }
+    //文件读取 工作线程里阻塞读和交给IoEngine
+    for (const char* mode : { "pread", "uring", "threads" })
+    {
+        try
+        {
+            benchFileRead(configs[0], threads, mode, 64 * scale);
+        }
+        catch (const char* err)
+        {
+            std::cerr << mode << ": " << err << std::endl;
+        }
+    }
+    return 0;
+}
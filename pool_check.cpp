@@ -0,0 +1,650 @@
+#include <iostream>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+#include "taskbatcher.h"
+#include "taskgroup.h"
+#include "ioengine.h"
+#include "parallel.h"
+
+/*
+回归检查 每个检查函数覆盖一项功能的基本行为或者一个修过的问题 全部通过时返回0
+由ctest运行 也可以直接执行
+*/
+
+static int failures = 0;
+
+#define CHECK(cond)                                                             \
+    do                                                                          \
+    {                                                                           \
+        if (!(cond))                                                            \
+        {                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+            failures++;                                                         \
+        }                                                                       \
+    } while (0)
+
+//唯一的工作线程被占住时提交的任务 放开后按执行顺序记录
+class OrderLog
+{
+public:
+    std::function<void()> record(const std::string& name)
+    {
+        return [this, name]() {
+            std::lock_guard<std::mutex> guard(mtx_);
+            order_ += name;
+        };
+    }
+
+    std::string order()
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        return order_;
+    }
+
+private:
+    std::mutex mtx_;
+    std::string order_;
+};
+
+//占住线程池唯一的工作线程 release之后才返回
+static Result<void> blockWorker(ThreadPool& pool, std::atomic_bool& release)
+{
+    std::atomic_bool started(false);
+    Result<void> blocker = pool.submit([&started, &release]() {
+        started = true;
+        while (!release)
+            std::this_thread::yield();
+    });
+    while (!started)
+        std::this_thread::yield();
+    return blocker;
+}
+
+//高优先级最先 带截止时间的按截止时间先后 然后是普通任务 低优先级最后
+//等待超过老化时间的低优先级任务先于普通任务执行
+static void checkPriorityOrder()
+{
+    ThreadPool pool;
+    pool.setPriorityAging(std::chrono::milliseconds(0));
+    pool.start(1);
+    OrderLog log;
+    std::atomic_bool release(false);
+    Result<void> blocker = blockWorker(pool, release);
+    auto now = std::chrono::steady_clock::now();
+    std::vector<Result<void>> results;
+    results.push_back(pool.submit(TaskPriority::PRIORITY_LOW, log.record("L")));
+    results.push_back(pool.submit(log.record("N")));
+    results.push_back(pool.submit(TaskPriority::PRIORITY_NORMAL, now + std::chrono::seconds(20), log.record("2")));
+    results.push_back(pool.submit(TaskPriority::PRIORITY_NORMAL, now + std::chrono::seconds(10), log.record("1")));
+    results.push_back(pool.submit(TaskPriority::PRIORITY_HIGH, log.record("H")));
+    release = true;
+    for (auto& res : results)
+        res.wait();
+    CHECK(log.order() == "H12NL");
+}
+
+static void checkPriorityAging()
+{
+    ThreadPool pool;
+    pool.setPriorityAging(std::chrono::milliseconds(1));
+    pool.start(1);
+    OrderLog log;
+    std::atomic_bool release(false);
+    Result<void> blocker = blockWorker(pool, release);
+    std::vector<Result<void>> results;
+    results.push_back(pool.submit(TaskPriority::PRIORITY_LOW, log.record("L")));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    results.push_back(pool.submit(log.record("N")));
+    results.push_back(pool.submit(TaskPriority::PRIORITY_NORMAL, std::chrono::steady_clock::now() + std::chrono::seconds(10), log.record("D")));
+    release = true;
+    for (auto& res : results)
+        res.wait();
+    CHECK(log.order() == "LDN");
+}
+
+//parallel_for每个下标恰好执行一次 parallel_reduce和parallel_transform的结果和顺序执行相同
+//grain取得很小 区间会被拆给多个线程 同时也在工作线程里嵌套调用一次
+static void checkParallel()
+{
+    ThreadPool pool;
+    pool.start(4);
+    const size_t n = 10000;
+    ParallelOptions options;
+    options.grain = 7;
+
+    std::vector<std::atomic_int> visits(n);
+    parallel_for(pool, 0, n, [&visits](size_t i) { visits[i]++; }, options);
+    parallel_for(pool, 0, n, [&visits](size_t b, size_t e) {
+        for (size_t i = b; i < e; i++)
+            visits[i]++;
+    }, options);
+    int wrong = 0;
+    for (size_t i = 0; i < n; i++)
+        wrong += visits[i] != 2;
+    CHECK(wrong == 0);
+
+    unsigned long long expected = (unsigned long long)n * (n - 1) / 2;
+    auto add = [](unsigned long long a, unsigned long long b) { return a + b; };
+    CHECK(parallel_reduce(pool, 0, n, 0ULL, [](size_t i) { return (unsigned long long)i; }, add, options) == expected);
+    CHECK(parallel_reduce(pool, 0, n, 0ULL, [](size_t b, size_t e) {
+        return (unsigned long long)(b + e - 1) * (e - b) / 2;
+    }, add, options) == expected);
+    CHECK(parallel_reduce(pool, 5, 5, 42ULL, [](size_t i) { return (unsigned long long)i; }, add) == 42ULL);
+
+    std::vector<int> in(n);
+    for (size_t i = 0; i < n; i++)
+        in[i] = (int)i;
+    std::vector<int> out(n, -1);
+    CHECK(parallel_transform(pool, in.begin(), in.end(), out.begin(), [](int x) { return x * 2; }) == out.end());
+    wrong = 0;
+    for (size_t i = 0; i < n; i++)
+        wrong += out[i] != 2 * (int)i;
+    CHECK(wrong == 0);
+
+    //任务里嵌套调用 等待拆出去的部分时执行排队的任务 不会死锁
+    Result<unsigned long long> nested = pool.submit([&pool, &options, add, n]() {
+        return parallel_reduce(pool, 0, n, 0ULL, [](size_t i) { return (unsigned long long)i; }, add, options);
+    });
+    CHECK(nested.get() == expected);
+
+    //某个下标抛出异常时 调用线程等其他部分结束后重新抛出
+    bool thrown = false;
+    try
+    {
+        parallel_for(pool, 0, n, [](size_t i) {
+            if (i == n / 2)
+                throw "bad index";
+        }, options);
+    }
+    catch (const char*)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+//队列满时每种拒绝策略的处理 唯一的工作线程被占住 上限阈值为2
+static void checkRejectPolicies()
+{
+    std::thread::id caller = std::this_thread::get_id();
+
+    //立即失败
+    {
+        ThreadPool pool;
+        pool.settaskQueMaxThreshHold(2);
+        pool.setRejectPolicy(RejectPolicy::REJECT_ABORT);
+        pool.start(1);
+        std::atomic_bool release(false);
+        Result<void> blocker = blockWorker(pool, release);
+        CHECK(pool.submit([]() {}).valid());
+        CHECK(pool.submit([]() {}).valid());
+        CHECK(!pool.submit([]() {}).valid());
+        CHECK(pool.stats().rejected == 1);
+        release = true;
+    }
+
+    //提交任务的线程自己执行
+    {
+        ThreadPool pool;
+        pool.settaskQueMaxThreshHold(2);
+        pool.setRejectPolicy(RejectPolicy::REJECT_CALLER_RUNS);
+        pool.start(1);
+        std::atomic_bool release(false);
+        Result<void> blocker = blockWorker(pool, release);
+        pool.submit([]() {});
+        pool.submit([]() {});
+        Result<std::thread::id> overflow = pool.submit([]() { return std::this_thread::get_id(); });
+        CHECK(overflow.valid());
+        CHECK(overflow.ready());
+        CHECK(overflow.get() == caller);
+        release = true;
+    }
+
+    //淘汰最早的任务 线程池内部依赖的任务(trySubmit)不丢弃 改为由提交的线程执行
+    {
+        ThreadPool pool;
+        pool.settaskQueMaxThreshHold(2);
+        pool.setRejectPolicy(RejectPolicy::REJECT_DISCARD_OLDEST);
+        pool.start(1);
+        std::atomic_bool release(false);
+        Result<void> blocker = blockWorker(pool, release);
+        Result<std::thread::id> internal = pool.trySubmit([]() { return std::this_thread::get_id(); });
+        Result<int> oldest = pool.submit([]() { return 1; });
+        Result<int> second = pool.submit([]() { return 2; });
+        CHECK(internal.ready());
+        CHECK(internal.get() == caller);
+        Result<int> third = pool.submit([]() { return 3; });
+        CHECK(oldest.ready());
+        CHECK(!oldest.valid());
+        bool thrown = false;
+        try
+        {
+            oldest.get();
+        }
+        catch (const char*)
+        {
+            thrown = true;
+        }
+        CHECK(thrown);
+        release = true;
+        CHECK(second.get() == 2);
+        CHECK(third.get() == 3);
+        CHECK(pool.stats().dropped == 1);
+    }
+
+    //阻塞等待 超时后失败 等待期间腾出位置时成功
+    for (int timeoutMs : { 20, 10000 })
+    {
+        ThreadPool pool;
+        pool.settaskQueMaxThreshHold(2);
+        pool.setRejectPolicy(RejectPolicy::REJECT_BLOCK, std::chrono::milliseconds(timeoutMs));
+        pool.start(1);
+        std::atomic_bool release(false);
+        Result<void> blocker = blockWorker(pool, release);
+        pool.submit([]() {});
+        pool.submit([]() {});
+        if (timeoutMs == 20)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            CHECK(!pool.submit([]() {}).valid());
+            CHECK(std::chrono::steady_clock::now() - begin >= std::chrono::milliseconds(20));
+            release = true;
+            continue;
+        }
+        std::thread releaser([&release]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            release = true;
+        });
+        Result<int> waited = pool.submit([]() { return 4; });
+        releaser.join();
+        CHECK(waited.valid());
+        CHECK(waited.get() == 4);
+    }
+}
+
+//延时任务不早于延时执行 取消的定时器不执行 周期定时器按周期重复 抛出异常也继续 取消后不再执行
+//线程池析构时还没到期的延时任务被丢弃 Result::get抛出异常
+static void checkTimers()
+{
+    Result<int> never(nullptr, false);
+    {
+        ThreadPool pool;
+        pool.start(2);
+        auto begin = std::chrono::steady_clock::now();
+        Result<int> delayed = pool.submitAfter(std::chrono::milliseconds(20), [](int a) { return a * 2; }, 21);
+        CHECK(!delayed.ready());
+        CHECK(delayed.get() == 42);
+        CHECK(std::chrono::steady_clock::now() - begin >= std::chrono::milliseconds(19));
+
+        std::atomic_int cancelledRuns(0);
+        std::atomic_int keptRuns(0);
+        TimerId cancelled = pool.scheduleAfter(std::chrono::milliseconds(10), [&cancelledRuns]() { cancelledRuns++; });
+        pool.scheduleAfter(std::chrono::milliseconds(10), [&keptRuns]() { keptRuns++; });
+        CHECK(pool.cancelTimer(cancelled));
+        CHECK(!pool.cancelTimer(cancelled));
+
+        std::atomic_int ticks(0);
+        TimerId periodic = pool.scheduleEvery(std::chrono::milliseconds(2), [&ticks]() {
+            if (++ticks == 2)
+                throw "periodic failure";
+        });
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (ticks < 5 && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        CHECK(ticks >= 5);
+        CHECK(pool.cancelTimer(periodic));
+        //正在执行的那一次可能在取消之后才结束
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        int stopped = ticks;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK(ticks == stopped);
+        CHECK(cancelledRuns == 0);
+        CHECK(keptRuns == 1);
+
+        never = pool.submitAfter(std::chrono::seconds(60), []() { return 0; });
+    }
+    CHECK(never.ready());
+    CHECK(!never.valid());
+    bool thrown = false;
+    try
+    {
+        never.get();
+    }
+    catch (const char*)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+//批量提交的任务也要记录所属的线程池 已经完成的任务再调用then时后续任务提交到线程池 不在调用then的线程上执行
+static void checkBatchThen()
+{
+    ThreadPool pool;
+    pool.start(2);
+    std::vector<std::function<int()>> funcs(8, []() { return 1; });
+    BatchResult<int> batch = pool.submitBatch(funcs.begin(), funcs.end());
+    CHECK(batch.allAccepted());
+    for (size_t i = 0; i < batch.size(); i++)
+        batch[i].wait();
+
+    std::thread::id caller = std::this_thread::get_id();
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        Result<std::thread::id> next = std::move(batch[i]).then([](int) { return std::this_thread::get_id(); });
+        CHECK(next.get() != caller);
+    }
+}
+
+//Result比线程池活得久 线程池析构后再调用then 后续任务在调用then的线程上直接执行 不访问已经析构的线程池
+static void checkThenOutlivesPool()
+{
+    Result<int> res(nullptr, false);
+    Result<int> combined(nullptr, false);
+    {
+        ThreadPool pool;
+        pool.start(2);
+        res = pool.submit([]() { return 1; });
+        res.wait();
+        std::vector<Result<int>> parts;
+        for (int i = 0; i < 4; i++)
+            parts.push_back(pool.submit([i]() { return i; }));
+        combined = when_all(std::move(parts)).then([](std::vector<int> values) {
+            int sum = 0;
+            for (int v : values)
+                sum += v;
+            return sum;
+        });
+        combined.wait();
+    }
+    std::thread::id caller = std::this_thread::get_id();
+    Result<std::thread::id> next = std::move(res).then([](int) { return std::this_thread::get_id(); });
+    CHECK(next.get() == caller);
+    Result<int> after = std::move(combined).then([](int sum) { return sum * 2; });
+    CHECK(after.get() == 12);
+}
+
+//无锁队列的阈值是2的幂时 预留了位置的任务可能遇到还没释放的槽位 入队不能失败 否则任务丢失Result永远等不到
+static void checkRingNoLoss()
+{
+    ThreadPool pool;
+    pool.settaskQueMode(TaskQueMode::QUE_LOCKFREE);
+    pool.settaskQueMaxThreshHold(4);
+    pool.setRejectPolicy(RejectPolicy::REJECT_BLOCK, std::chrono::seconds(10));
+    pool.start(4);
+    std::vector<std::thread> producers;
+    std::atomic_int lost(0);
+    for (int p = 0; p < 3; p++)
+    {
+        producers.emplace_back([&pool, &lost]() {
+            std::vector<Result<int>> results;
+            for (int i = 0; i < 20000; i++)
+                results.push_back(pool.submit([i]() { return i; }));
+            for (auto& res : results)
+            {
+                if (res.valid() && !res.wait_for(std::chrono::seconds(5)))
+                    lost++;
+            }
+        });
+    }
+    for (std::thread& t : producers)
+        t.join();
+    CHECK(lost == 0);
+}
+
+//批量提交只接受队列剩余的位置 和单个提交、节点队列的预留一起也不超过上限阈值
+static void checkBatchThreshold()
+{
+    ThreadPool pool;
+    pool.settaskQueMaxThreshHold(8);
+    pool.setRejectPolicy(RejectPolicy::REJECT_ABORT);
+    pool.setNumaAware(true);
+    pool.start(1);
+    std::atomic_bool started(false);
+    std::atomic_bool release(false);
+    Result<void> blocker = pool.submit([&started, &release]() {
+        started = true;
+        while (!release)
+            std::this_thread::yield();
+    });
+    while (!started)
+        std::this_thread::yield();
+    for (int i = 0; i < 2; i++)
+        CHECK(pool.submit([]() {}).valid());
+    CHECK(pool.submitToNode(0, []() {}).valid());
+    std::vector<std::function<void()>> funcs(20, []() {});
+    BatchResult<void> batch = pool.submitBatch(funcs.begin(), funcs.end());
+    CHECK(batch.accepted() == 5);
+    CHECK(!pool.trySubmit([]() {}).valid());
+    release = true;
+    blocker.wait();
+}
+
+//cache模式扩容后很快析构 控制线程发出的回收名额不能让线程不通知析构函数就退出 否则析构一直等下去
+//卡住时由ctest的超时报告
+static void checkCachedShutdown()
+{
+    for (int round = 0; round < 20; round++)
+    {
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_CACHED);
+        pool.setMinThreadSize(1);
+        pool.setThreadKeepAlive(std::chrono::milliseconds(1));
+        pool.setTargetQueueWait(std::chrono::microseconds(1));
+        pool.start(1);
+        std::vector<Result<void>> results;
+        for (int i = 0; i < 64; i++)
+            results.push_back(pool.submit([]() { std::this_thread::sleep_for(std::chrono::microseconds(200)); }));
+        for (auto& res : results)
+            res.wait();
+        std::this_thread::sleep_for(std::chrono::milliseconds(round % 5));
+    }
+}
+
+//工作窃取模式下工作线程提交的子任务放入本地队列 几个线程同时提交也不能超过上限阈值
+//两个根任务都开始执行后才提交子任务 都提交完才返回 期间子任务不会被取走
+static void checkLocalThreshold()
+{
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_STEALING);
+    pool.settaskQueMaxThreshHold(8);
+    pool.start(2);
+    std::atomic_int started(0);
+    std::atomic_int finished(0);
+    std::atomic_int accepted(0);
+    std::vector<Result<void>> roots;
+    for (int r = 0; r < 2; r++)
+    {
+        roots.push_back(pool.submit([&pool, &started, &finished, &accepted]() {
+            started++;
+            while (started < 2)
+                std::this_thread::yield();
+            for (int i = 0; i < 100; i++)
+            {
+                if (pool.trySubmit([]() {}).valid())
+                    accepted++;
+            }
+            //先提交完的线程不能去执行另一个线程的子任务
+            finished++;
+            while (finished < 2)
+                std::this_thread::yield();
+        }));
+    }
+    for (auto& res : roots)
+        res.wait();
+    CHECK(accepted <= 8);
+}
+
+//攒批执行时一个用户任务抛出异常 同一批后面的任务照常执行 抛出异常的任务的Result也能等到
+class ThrowingTask : public Task
+{
+public:
+    Any run() override
+    {
+        throw "boom";
+    }
+};
+
+static void checkBatchThrow()
+{
+    ThreadPool pool;
+    pool.start(2);
+    TaskBatcher batcher(pool, 16, std::chrono::microseconds(0));
+    std::vector<Result<int>> before;
+    std::vector<Result<int>> after;
+    for (int i = 0; i < 4; i++)
+        before.push_back(batcher.submit([i]() { return i; }));
+    Result<> thrown = batcher.submitTask(std::make_shared<ThrowingTask>());
+    for (int i = 0; i < 4; i++)
+        after.push_back(batcher.submit([i]() { return i; }));
+    batcher.flush();
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK(before[i].get() == i);
+        CHECK(after[i].wait_for(std::chrono::seconds(5)));
+        CHECK(after[i].get() == i);
+    }
+    CHECK(thrown.wait_for(std::chrono::seconds(5)));
+}
+
+//攒批对象比线程池活得久 线程池析构前攒着的任务和之后提交的任务都在当前线程执行 不访问已经析构的线程池
+static void checkBatcherOutlivesPool()
+{
+    std::unique_ptr<TaskBatcher> batcher;
+    std::vector<Result<int>> results;
+    {
+        ThreadPool pool;
+        pool.start(2);
+        batcher = std::make_unique<TaskBatcher>(pool, 16, std::chrono::seconds(10));
+        for (int i = 0; i < 4; i++)
+            results.push_back(batcher->submit([i]() { return i; }));
+    }
+    for (int i = 4; i < 8; i++)
+        results.push_back(batcher->submit([i]() { return i; }));
+    batcher.reset();
+    for (int i = 0; i < 8; i++)
+    {
+        CHECK(results[i].wait_for(std::chrono::seconds(5)));
+        CHECK(results[i].get() == i);
+    }
+}
+
+//任务组的句柄比线程池活得久 线程池析构前提交的任务都执行完 之后的提交失败 不访问已经析构的线程池
+static void checkGroupOutlivesPool()
+{
+    std::unique_ptr<TaskGroup> group;
+    std::atomic_int ran(0);
+    {
+        ThreadPool pool;
+        pool.start(2);
+        group = std::make_unique<TaskGroup>(pool, 1);
+        group->setMaxConcurrency(1);
+        for (int i = 0; i < 50; i++)
+            group->submit([&ran]() { ran++; });
+    }
+    CHECK(ran == 50);
+    CHECK(!group->submit([]() {}).valid());
+    group->wait();
+}
+
+//IoEngine在临时文件和管道上读写一遍 io_uring和I/O线程两种方式结果相同
+//内核不支持或者禁止io_uring时跳过IO_URING
+static void checkIoRoundTrip(IoBackend backend, const char* name)
+{
+    ThreadPool pool;
+    pool.start(2);
+    std::unique_ptr<IoEngine> io;
+    try
+    {
+        io = std::make_unique<IoEngine>(pool, 16, backend);
+    }
+    catch (const char* err)
+    {
+        std::cout << name << ": skipped (" << err << ")" << std::endl;
+        return;
+    }
+    CHECK(io->backend() == backend);
+
+    //临时文件 按offset写入后读回
+    char path[] = "/tmp/pool_check_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    unlink(path);
+    const char text[] = "threadpool io round trip";
+    size_t len = sizeof(text) - 1;
+    CHECK(io->write(fd, text, len, 0).get() == (long)len);
+    CHECK(io->write(fd, text, len, (int64_t)len).get() == (long)len);
+    CHECK(io->fsync(fd).get() == 0);
+    char buf[64] = {};
+    CHECK(io->read(fd, buf, len, (int64_t)len).get() == (long)len);
+    CHECK(memcmp(buf, text, len) == 0);
+
+    //固定缓冲区
+    char fixed[64] = {};
+    std::vector<iovec> buffers(1);
+    buffers[0].iov_base = fixed;
+    buffers[0].iov_len = sizeof(fixed);
+    io->registerBuffers(buffers);
+    CHECK(io->readFixed(fd, 0, 8, len, 0).get() == (long)len);
+    CHECK(memcmp(fixed + 8, text, len) == 0);
+
+    //读到文件末尾返回0 无效的fd返回-EBADF
+    CHECK(io->read(fd, buf, sizeof(buf), 2 * (int64_t)len).get() == 0);
+    CHECK(io->read(-1, buf, sizeof(buf), 0).get() == -EBADF);
+    close(fd);
+
+    //管道 不能定位 从当前位置读写 读在写之前提交 写完之后才完成
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    char pipeBuf[64] = {};
+    Result<long> pending = io->read(fds[0], pipeBuf, sizeof(pipeBuf));
+    CHECK(io->write(fds[1], text, len).get() == (long)len);
+    CHECK(pending.get() == (long)len);
+    CHECK(memcmp(pipeBuf, text, len) == 0);
+    close(fds[1]);
+    CHECK(io->read(fds[0], pipeBuf, sizeof(pipeBuf)).get() == 0);
+    close(fds[0]);
+    std::cout << name << ": ok" << std::endl;
+}
+
+int main()
+{
+    checkPriorityOrder();
+    checkPriorityAging();
+    checkParallel();
+    checkRejectPolicies();
+    checkTimers();
+    checkBatchThen();
+    checkThenOutlivesPool();
+    checkRingNoLoss();
+    checkBatchThreshold();
+    checkCachedShutdown();
+    checkLocalThreshold();
+    checkBatchThrow();
+    checkBatcherOutlivesPool();
+    checkGroupOutlivesPool();
+    checkIoRoundTrip(IoBackend::IO_URING, "io_uring");
+    checkIoRoundTrip(IoBackend::IO_THREADS, "io threads");
+    if (failures != 0)
+    {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "poolalloc.h"
+#include <mutex>
+#include <stdint.h>
+
+//AddressSanitizer下不复用内存 否则检查不出释放后使用
+#ifndef THREADPOOL_NO_ARENA
+#if defined(__SANITIZE_ADDRESS__)
+#define THREADPOOL_NO_ARENA
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define THREADPOOL_NO_ARENA
+#endif
+#endif
+#endif
+
+const size_t ARENA_CLASS_SIZE = CACHE_LINE_SIZE; //大小类别的间隔 也是块的对齐
+const size_t ARENA_CLASS_COUNT = 16;             //大小类别的数量 最大1KB
+const size_t ARENA_MAX_SIZE = ARENA_CLASS_SIZE * ARENA_CLASS_COUNT;
+const size_t ARENA_SLAB_SIZE = 64 * 1024;        //每次向系统申请的slab大小
+const size_t ARENA_BATCH_SIZE = 32;              //线程和中心链表之间一次转移的块数量
+
+#ifndef THREADPOOL_NO_ARENA
+
+//空闲块 块不小于64字节 空闲时用开头几个字节串成链表
+struct FreeBlock
+{
+    FreeBlock* next_;      //同一批里的下一块
+    FreeBlock* nextBatch_; //中心链表里的下一批 只在每批的第一块有效
+    size_t batchCount_;    //这一批的块数量 只在每批的第一块有效
+};
+
+//一个大小类别的中心链表 按批存放 取回和归还都是O(1)
+struct CentralList
+{
+    std::mutex mtx_;
+    FreeBlock* batches_ = nullptr;
+};
+
+//所有线程共享 永不释放 线程退出时的归还不受静态对象析构顺序影响
+static CentralList* centralLists()
+{
+    static CentralList* lists = new CentralList[ARENA_CLASS_COUNT];
+    return lists;
+}
+
+//大小类别的下标
+static inline size_t classIndex(size_t size)
+{
+    return size == 0 ? 0 : (size - 1) / ARENA_CLASS_SIZE;
+}
+
+static inline size_t classSize(size_t index)
+{
+    return (index + 1) * ARENA_CLASS_SIZE;
+}
+
+//把一批块放入中心链表
+static void pushBatch(size_t index, FreeBlock* head, size_t count)
+{
+    head->batchCount_ = count;
+    CentralList& central = centralLists()[index];
+    std::lock_guard<std::mutex> guard(central.mtx_);
+    head->nextBatch_ = central.batches_;
+    central.batches_ = head;
+}
+
+//从中心链表取回一批块 没有时返回nullptr
+static FreeBlock* popBatch(size_t index, size_t& count)
+{
+    CentralList& central = centralLists()[index];
+    std::lock_guard<std::mutex> guard(central.mtx_);
+    FreeBlock* head = central.batches_;
+    if (head != nullptr)
+    {
+        central.batches_ = head->nextBatch_;
+        count = head->batchCount_;
+    }
+    return head;
+}
+
+//线程私有的空闲链表
+struct LocalCache
+{
+    struct List
+    {
+        FreeBlock* head_ = nullptr;
+        size_t count_ = 0;
+    };
+    List lists_[ARENA_CLASS_COUNT];
+
+    ~LocalCache();
+};
+
+//0 还没有使用 1 可以使用 2 线程退出时已经析构 之后的分配和释放直接访问中心链表
+static thread_local int tlsCacheState = 0;
+static thread_local LocalCache tlsCache;
+
+LocalCache::~LocalCache()
+{
+    //线程退出 剩下的块整条链表作为一批还给中心链表
+    for (size_t i = 0; i < ARENA_CLASS_COUNT; i++)
+    {
+        if (lists_[i].head_ != nullptr)
+            pushBatch(i, lists_[i].head_, lists_[i].count_);
+        lists_[i].head_ = nullptr;
+        lists_[i].count_ = 0;
+    }
+    tlsCacheState = 2;
+}
+
+static inline LocalCache* localCache()
+{
+    if (tlsCacheState == 2)
+        return nullptr;
+    tlsCacheState = 1;
+    return &tlsCache;
+}
+
+//申请一个slab 切成块放入线程的空闲链表
+static void carveSlab(LocalCache::List& list, size_t index)
+{
+    size_t size = classSize(index);
+    char* slab = static_cast<char*>(::operator new(ARENA_SLAB_SIZE, std::align_val_t(CACHE_LINE_SIZE)));
+    for (size_t offset = 0; offset + size <= ARENA_SLAB_SIZE; offset += size)
+    {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + offset);
+        block->next_ = list.head_;
+        list.head_ = block;
+        list.count_++;
+    }
+}
+
+void* PoolArena::allocate(size_t size)
+{
+    if (size > ARENA_MAX_SIZE)
+        return ::operator new(size, std::align_val_t(CACHE_LINE_SIZE));
+
+    size_t index = classIndex(size);
+    LocalCache* cache = localCache();
+    if (cache == nullptr)
+    {
+        //线程正在退出 直接申请一块 释放后和slab切出的块一样使用
+        return ::operator new(classSize(index), std::align_val_t(CACHE_LINE_SIZE));
+    }
+
+    LocalCache::List& list = cache->lists_[index];
+    if (list.head_ == nullptr)
+    {
+        size_t count = 0;
+        list.head_ = popBatch(index, count);
+        list.count_ = count;
+        if (list.head_ == nullptr)
+            carveSlab(list, index);
+    }
+    FreeBlock* block = list.head_;
+    list.head_ = block->next_;
+    list.count_--;
+    return block;
+}
+
+void PoolArena::deallocate(void* ptr, size_t size) noexcept
+{
+    if (ptr == nullptr)
+        return;
+    if (size > ARENA_MAX_SIZE)
+    {
+        ::operator delete(ptr, std::align_val_t(CACHE_LINE_SIZE));
+        return;
+    }
+
+    size_t index = classIndex(size);
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    LocalCache* cache = localCache();
+    if (cache == nullptr)
+    {
+        block->next_ = nullptr;
+        pushBatch(index, block, 1);
+        return;
+    }
+
+    LocalCache::List& list = cache->lists_[index];
+    block->next_ = list.head_;
+    list.head_ = block;
+    list.count_++;
+
+    //释放的块比一批多出一倍时 把一批还给中心链表 留给分配任务的线程取回
+    if (list.count_ >= 2 * ARENA_BATCH_SIZE)
+    {
+        FreeBlock* head = list.head_;
+        FreeBlock* tail = head;
+        for (size_t i = 1; i < ARENA_BATCH_SIZE; i++)
+            tail = tail->next_;
+        list.head_ = tail->next_;
+        list.count_ -= ARENA_BATCH_SIZE;
+        tail->next_ = nullptr;
+        pushBatch(index, head, ARENA_BATCH_SIZE);
+    }
+}
+
+#else
+
+void* PoolArena::allocate(size_t size)
+{
+    return ::operator new(size, std::align_val_t(CACHE_LINE_SIZE));
+}
+
+void PoolArena::deallocate(void* ptr, size_t) noexcept
+{
+    ::operator delete(ptr, std::align_val_t(CACHE_LINE_SIZE));
+}
+
+#endif
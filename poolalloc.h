@@ -0,0 +1,117 @@
+/*线程池的小对象分配器 任务对象、任务队列节点和后续回调的内存从这里分配*/
+
+#ifndef POOLALLOC_H
+#define POOLALLOC_H
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <stddef.h>
+
+#include "ringqueue.h" //CACHE_LINE_SIZE
+
+/*
+按64字节一档把小于等于1KB的请求分成16个大小类别 每个类别从64KB的slab中切块
+每个线程有自己的空闲链表 分配和释放都不加锁
+任务通常在提交线程分配、在工作线程释放 工作线程的空闲链表超过上限后把一批块交给中心链表
+提交线程的空闲链表用完时从中心链表取回一批 块就这样在线程之间流转 稳定状态下不再调用malloc
+块的地址按缓存行对齐 slab只增不减 不还给操作系统
+大于1KB的请求直接使用operator new
+定义THREADPOOL_NO_ARENA或者开启AddressSanitizer时所有请求都直接使用operator new 便于检查内存错误
+*/
+class PoolArena
+{
+public:
+    //分配size字节 地址按CACHE_LINE_SIZE对齐
+    static void* allocate(size_t size);
+
+    //释放allocate得到的内存 size必须和分配时相同 可以在任何线程释放
+    static void deallocate(void* ptr, size_t size) noexcept;
+
+    //在arena中构造一个对象 对齐要求超过缓存行的类型使用operator new
+    template<typename T, typename... Args>
+    static T* create(Args&&... args)
+    {
+        if constexpr (alignof(T) > CACHE_LINE_SIZE)
+        {
+            return new T(std::forward<Args>(args)...);
+        }
+        else
+        {
+            void* ptr = allocate(sizeof(T));
+            try
+            {
+                return new (ptr) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                deallocate(ptr, sizeof(T));
+                throw;
+            }
+        }
+    }
+
+    //析构并释放create得到的对象
+    template<typename T>
+    static void destroy(T* ptr) noexcept
+    {
+        if constexpr (alignof(T) > CACHE_LINE_SIZE)
+        {
+            delete ptr;
+        }
+        else
+        {
+            ptr->~T();
+            deallocate(ptr, sizeof(T));
+        }
+    }
+};
+
+//使用PoolArena的标准分配器 用于std::allocate_shared和标准容器
+template<typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept
+    {}
+
+    T* allocate(size_t n)
+    {
+        if constexpr (alignof(T) > CACHE_LINE_SIZE)
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        else
+            return static_cast<T*>(PoolArena::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept
+    {
+        if constexpr (alignof(T) > CACHE_LINE_SIZE)
+            ::operator delete(ptr, std::align_val_t(alignof(T)));
+        else
+            PoolArena::deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept
+    {
+        return true;
+    }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept
+    {
+        return false;
+    }
+};
+
+//在arena中创建shared_ptr管理的对象 控制块和对象在同一块内存中
+template<typename T, typename... Args>
+std::shared_ptr<T> allocateShared(Args&&... args)
+{
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+#endif
@@ -0,0 +1,161 @@
+/*线程池运行统计 ThreadPool::stats()返回的快照*/
+
+#ifndef POOLSTATS_H
+#define POOLSTATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+//延迟直方图(HDR风格)：按2的幂分段 每段再均分16个子桶 任意值的相对误差不超过1/16
+//记录和合并都是O(1) 不需要保存每一个样本 单位纳秒
+class LatencyHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    LatencyHistogram()
+        : counts_()
+        , total_(0)
+        , sum_(0)
+        , max_(0)
+    {}
+
+    //数值所在的桶
+    static int bucketIndex(uint64_t value)
+    {
+        if (value < (uint64_t)SUB_BUCKET_COUNT)
+            return (int)value;
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SUB_BUCKET_BITS;
+        int sub = (int)((value >> shift) & (SUB_BUCKET_COUNT - 1));
+        return (shift + 1) * SUB_BUCKET_COUNT + sub;
+    }
+
+    //桶能表示的最大值
+    static uint64_t bucketUpperBound(int index)
+    {
+        if (index < SUB_BUCKET_COUNT)
+            return (uint64_t)index;
+        int shift = index / SUB_BUCKET_COUNT - 1;
+        uint64_t sub = (uint64_t)(index % SUB_BUCKET_COUNT);
+        return ((SUB_BUCKET_COUNT + sub + 1) << shift) - 1;
+    }
+
+    void record(uint64_t value)
+    {
+        counts_[bucketIndex(value)]++;
+        total_++;
+        sum_ += value;
+        if (value > max_)
+            max_ = value;
+    }
+
+    //按桶累加 用于合并各线程的直方图
+    void addBucket(int index, uint64_t count)
+    {
+        counts_[index] += count;
+        total_ += count;
+    }
+
+    void addSummary(uint64_t sum, uint64_t max)
+    {
+        sum_ += sum;
+        if (max > max_)
+            max_ = max;
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for (int i = 0; i < BUCKET_COUNT; i++)
+            counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        addSummary(other.sum_, other.max_);
+    }
+
+    uint64_t count() const
+    {
+        return total_;
+    }
+
+    uint64_t max() const
+    {
+        return max_;
+    }
+
+    double mean() const
+    {
+        return total_ == 0 ? 0.0 : (double)sum_ / (double)total_;
+    }
+
+    //百分位数 p取0到100
+    uint64_t percentile(double p) const
+    {
+        if (total_ == 0)
+            return 0;
+        uint64_t rank = (uint64_t)(p / 100.0 * (double)total_);
+        if (rank >= total_)
+            rank = total_ - 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++)
+        {
+            seen += counts_[i];
+            if (seen > rank)
+                return bucketUpperBound(i) < max_ ? bucketUpperBound(i) : max_;
+        }
+        return max_;
+    }
+
+private:
+    uint64_t counts_[BUCKET_COUNT];
+    uint64_t total_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
+//线程池统计快照 计数器从线程池启动开始累计
+struct PoolStats
+{
+    //当前状态
+    int curThreadSize = 0;  //当前线程数量
+    int idleThreadSize = 0; //空闲线程数量
+    int taskSize = 0;       //排队中的任务数量
+
+    //累计计数
+    uint64_t submitted = 0;      //提交成功的任务
+    uint64_t rejected = 0;       //队列满提交失败的任务
+    uint64_t callerRuns = 0;     //队列满时由提交任务的线程执行的任务
+    uint64_t dropped = 0;        //队列满时被淘汰的最早的任务
+    uint64_t expired = 0;        //超过截止时间被丢弃的任务
+    uint64_t completed = 0;      //执行完的任务
+    uint64_t threadsCreated = 0; //cache模式下新创建的线程
+    uint64_t threadsReaped = 0;  //cache模式下空闲超时回收的线程
+    uint64_t steals = 0;         //工作窃取模式下从其他线程窃取到的任务
+    uint64_t parks = 0;          //线程因为没有任务进入睡眠的次数
+    uint64_t helped = 0;         //工作线程等待结果时执行的排队任务
+    uint64_t compensated = 0;    //工作线程阻塞时启用补偿线程的次数(新建或者唤醒备用的)
+
+    //需要先调用ThreadPool::setTaskTiming(true)
+    LatencyHistogram queueWait; //任务从入队到开始执行的等待时间
+    LatencyHistogram runTime;   //任务的执行时间
+};
+
+//任务组统计快照 TaskGroup::stats()返回
+struct TaskGroupStats
+{
+    //当前状态
+    int weight = 0;         //权重
+    int maxConcurrency = 0; //同时执行的任务上限 0表示不限制
+    int queued = 0;         //在组队列里等待调度的任务
+    int running = 0;        //已经交给线程池还没执行完的任务
+
+    //累计计数
+    uint64_t submitted = 0; //提交成功的任务
+    uint64_t rejected = 0;  //组队列满提交失败的任务
+    uint64_t completed = 0; //执行完的任务
+
+    LatencyHistogram queueWait; //任务在组队列里等待调度的时间 不含在线程池队列里的时间
+};
+
+#endif
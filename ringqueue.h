@@ -0,0 +1,130 @@
+/*有界无锁多生产者多消费者环形队列 线程池内部使用*/
+
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+//缓存行大小 头尾指针分开放 避免生产者和消费者互相踩同一缓存行(伪共享)
+const size_t CACHE_LINE_SIZE = 64;
+
+//每个槽位带一个序号：
+//  seq == pos       槽位空 生产者可以写入位置pos
+//  seq == pos + 1   槽位已写入 消费者可以读取位置pos
+//读取后把seq设为 pos + capacity 表示下一圈的生产者可以写入
+//生产者和消费者只在各自的位置上CAS 不需要锁
+template<typename T>
+class RingQueue
+{
+public:
+    //容量向上取整到2的幂 用掩码代替取模
+    explicit RingQueue(size_t capacity)
+        : mask_(roundUpPow2(capacity) - 1)
+        , slots_(new Slot[mask_ + 1])
+        , enqueuePos_(0)
+        , dequeuePos_(0)
+    {
+        for (size_t i = 0; i <= mask_; i++)
+        {
+            slots_[i].seq_.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~RingQueue() = default;
+
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    //放入一个元素 队列满返回false
+    bool push(T&& data)
+    {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = slots_[pos & mask_];
+            size_t seq = slot.seq_.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0)
+            {
+                //槽位空 抢占这个位置
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.data_ = std::move(data);
+                    slot.seq_.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                //上一圈的数据还没被取走 队列满
+                return false;
+            }
+            else
+            {
+                //被其他生产者抢先了 重新读取位置
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //取出一个元素 队列空返回false
+    bool pop(T& data)
+    {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = slots_[pos & mask_];
+            size_t seq = slot.seq_.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    data = std::move(slot.data_);
+                    slot.data_ = T();//及时释放元素持有的资源
+                    slot.seq_.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                //这个位置还没有写入 队列空
+                return false;
+            }
+            else
+            {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+private:
+    static size_t roundUpPow2(size_t n)
+    {
+        size_t cap = 2;
+        while (cap < n)
+            cap <<= 1;
+        return cap;
+    }
+
+    struct Slot
+    {
+        std::atomic<size_t> seq_;
+        T data_;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueuePos_; //生产者位置
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeuePos_; //消费者位置
+    char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+#endif
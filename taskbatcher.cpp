@@ -0,0 +1,155 @@
+#include "taskbatcher.h"
+#include "logger.h"
+#include <algorithm>
+
+//攒批的状态 由TaskBatcher和还没到期的定时器共同持有 定时器到期时TaskBatcher可能已经析构
+struct BatchState
+{
+    std::shared_ptr<PoolHandle> pool_; //线程池析构后关闭 之后的批次在当前线程直接执行
+    size_t maxBatch_ = 1;
+    std::chrono::microseconds maxDelay_{ 0 };
+
+    mutable std::mutex mtx_;
+    std::vector<std::shared_ptr<Task>> tasks_; //当前这一批
+    uint64_t generation_ = 0; //已经提交的批数 定时器据此判断它等的那一批是否已经提交
+    TimerId timer_ = 0;       //当前这一批的定时器 0表示没有
+
+    //取走当前这一批 调用者必须持有mtx_ 返回需要取消的定时器
+    TimerId takeBatch(std::vector<std::shared_ptr<Task>>& batch)
+    {
+        batch.swap(tasks_);
+        tasks_.reserve(maxBatch_);
+        generation_++;
+        TimerId timer = timer_;
+        timer_ = 0;
+        return timer;
+    }
+
+    //把一批任务作为一个任务提交 调用者不能持有mtx_
+    void dispatch(std::vector<std::shared_ptr<Task>> batch, TimerId timer);
+
+    //定时器到期 它等的那一批还没提交时提交
+    void expire(uint64_t generation);
+};
+
+void BatchState::dispatch(std::vector<std::shared_ptr<Task>> batch, TimerId timer)
+{
+    if (timer != 0)
+        pool_->withPool([timer](ThreadPool& pool) { pool.cancelTimer(timer); });
+    if (batch.empty())
+        return;
+
+    //一个工作线程按提交顺序连续执行 每个任务执行完各自通知自己的Result
+    auto run = [tasks = std::move(batch)]()
+    {
+        TaskBatcher::runBatch(tasks);
+    };
+    auto unit = allocateShared<FuncTask<void, decltype(run)>>(std::move(run));
+    if (!pool_->trySubmitTask(unit))
+    {
+        unit->exec();
+    }
+}
+
+void BatchState::expire(uint64_t generation)
+{
+    std::vector<std::shared_ptr<Task>> batch;
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        if (generation != generation_)
+            return;
+        //定时器已经到期 不用取消
+        timer_ = 0;
+        takeBatch(batch);
+    }
+    dispatch(std::move(batch), 0);
+}
+
+void TaskBatcher::runBatch(const std::vector<std::shared_ptr<Task>>& tasks)
+{
+    for (const std::shared_ptr<Task>& task : tasks)
+    {
+        //submit生成的任务自己保存异常 用户从Task派生的run抛出异常时不能让同一批后面的任务都不执行
+        //这个任务按没有返回值完成 等待它的Result不会一直阻塞
+        try
+        {
+            task->exec();
+        }
+        catch (...)
+        {
+            POOL_LOG_ERROR("批量执行的任务抛出异常!");
+            task->complete();
+        }
+    }
+}
+
+TaskBatcher::TaskBatcher(ThreadPool& pool, size_t maxBatch, std::chrono::microseconds maxDelay)
+    : state_(std::make_shared<BatchState>())
+{
+    state_->pool_ = pool.handle_;
+    state_->maxBatch_ = std::max(maxBatch, (size_t)1);
+    state_->maxDelay_ = std::max(maxDelay, std::chrono::microseconds(0));
+    state_->tasks_.reserve(state_->maxBatch_);
+}
+
+TaskBatcher::~TaskBatcher()
+{
+    flush();
+}
+
+Result<> TaskBatcher::submitTask(std::shared_ptr<Task> sp)
+{
+    append(sp);
+    return Result<>(std::move(sp), true);
+}
+
+void TaskBatcher::flush()
+{
+    std::vector<std::shared_ptr<Task>> batch;
+    TimerId timer;
+    {
+        std::lock_guard<std::mutex> guard(state_->mtx_);
+        timer = state_->takeBatch(batch);
+    }
+    state_->dispatch(std::move(batch), timer);
+}
+
+size_t TaskBatcher::pending() const
+{
+    std::lock_guard<std::mutex> guard(state_->mtx_);
+    return state_->tasks_.size();
+}
+
+void TaskBatcher::append(std::shared_ptr<Task> task)
+{
+    //后续任务(then)提交到同一个线程池
+    task->pool_ = state_->pool_;
+
+    std::vector<std::shared_ptr<Task>> batch;
+    TimerId timer = 0;
+    {
+        std::lock_guard<std::mutex> guard(state_->mtx_);
+        state_->tasks_.push_back(std::move(task));
+        if (state_->tasks_.size() >= state_->maxBatch_)
+        {
+            timer = state_->takeBatch(batch);
+        }
+        else if (state_->tasks_.size() == 1 && state_->maxDelay_.count() > 0)
+        {
+            //每一批的第一个任务启动定时器 攒够提前提交时取消
+            std::weak_ptr<BatchState> weak = state_;
+            uint64_t generation = state_->generation_;
+            bool scheduled = state_->pool_->withPool([&](ThreadPool& pool) {
+                state_->timer_ = pool.scheduleAfter(state_->maxDelay_, [weak, generation]() {
+                    if (std::shared_ptr<BatchState> state = weak.lock())
+                        state->expire(generation);
+                });
+            });
+            //线程池已经析构 没有定时器 不再攒批
+            if (!scheduled)
+                timer = state_->takeBatch(batch);
+        }
+    }
+    if (!batch.empty())
+        state_->dispatch(std::move(batch), timer);
+}
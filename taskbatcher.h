@@ -0,0 +1,84 @@
+/*小任务攒批 多个小任务合成一次提交 由一个工作线程连续执行*/
+
+#ifndef TASKBATCHER_H
+#define TASKBATCHER_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+
+#include "threadpool.h"
+
+struct BatchState;
+
+/*
+不到一微秒的任务 入队加锁、唤醒线程、取任务的开销比任务本身还大
+TaskBatcher在提交方把连续提交的任务攒起来 攒够maxBatch个、最早的任务等了maxDelay或者调用flush时
+整批作为一个任务提交到线程池 一个工作线程按提交顺序连续执行 每个任务的Result仍然单独完成
+线程池的统计里一批只算一个任务
+
+maxDelay由线程池的定时器保证 精度是定时器的刻度(1毫秒) 为0时只按数量和flush提交
+线程池队列满提交失败时在当前线程直接执行这一批 和Result::then一样保证任务不会丢失
+可以被多个线程同时使用 析构时提交剩下的任务
+可以比线程池活得久 线程池析构后每一批在提交它的线程上直接执行 设置了maxDelay时不再攒批
+
+example:
+TaskBatcher batcher(pool, 64, std::chrono::microseconds(500));
+std::vector<Result<int>> results;
+for (int i = 0; i < 10000; i++)
+    results.push_back(batcher.submit([](int x) { return x * x; }, i));
+batcher.flush();
+for (auto& res : results)
+    res.get();
+*/
+class TaskBatcher
+{
+public:
+    explicit TaskBatcher(ThreadPool& pool, size_t maxBatch = 64,
+        std::chrono::microseconds maxDelay = std::chrono::microseconds(1000));
+    ~TaskBatcher();
+    TaskBatcher(const TaskBatcher&) = delete;
+    TaskBatcher& operator=(const TaskBatcher&) = delete;
+
+    //提交任意可调用对象和参数 返回带类型的Result<T>
+    template<typename Func, typename... Args>
+    auto submit(Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        using RType = typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type;
+        auto call = [func = std::forward<Func>(func), args = std::make_tuple(std::forward<Args>(args)...)]() mutable -> RType
+        {
+            return std::apply(func, std::move(args));
+        };
+        auto task = allocateShared<FuncTask<RType, decltype(call)>>(std::move(call));
+        append(task);
+        return Result<RType>(std::move(task), true);
+    }
+
+    //提交任务
+    Result<> submitTask(std::shared_ptr<Task> sp);
+
+    //立即提交攒着的任务
+    void flush();
+
+    //攒着还没提交的任务数量
+    size_t pending() const;
+
+private:
+    friend struct BatchState;
+
+    //任务放入当前这一批 攒够时提交
+    void append(std::shared_ptr<Task> task);
+
+    //按顺序执行一批任务 一个任务抛出异常不影响后面的任务
+    static void runBatch(const std::vector<std::shared_ptr<Task>>& tasks);
+
+    std::shared_ptr<BatchState> state_;
+};
+
+#endif
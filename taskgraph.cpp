@@ -0,0 +1,161 @@
+#include "taskgraph.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <exception>
+
+//一次运行的状态 由这次运行的所有节点任务共同持有 图对象可以在运行结束前销毁或再次运行
+struct GraphRun
+{
+    std::shared_ptr<PoolHandle> pool_; //线程池析构后节点在当前线程直接执行
+    std::vector<std::function<void()>> funcs_;
+    std::vector<std::vector<size_t>> successors_;
+    std::unique_ptr<std::atomic<size_t>[]> pending_; //每个节点还没执行完的前驱数量
+    std::atomic<size_t> remaining_{ 0 };              //还没结束的节点数量
+    std::atomic_bool failed_{ false };                //有节点抛出了异常 之后的节点不再执行
+    std::mutex errorMtx_;
+    std::exception_ptr error_;                        //第一个异常
+    std::shared_ptr<Task> done_;                      //所有节点结束后执行 通知run返回的Result
+};
+
+static void runNode(const std::shared_ptr<GraphRun>& run, size_t node);
+
+//把节点提交到线程池 队列满或者线程池已经析构时在当前线程直接执行 保证整张图一定能结束
+static void submitNode(const std::shared_ptr<GraphRun>& run, size_t node)
+{
+    auto call = [run, node]() { runNode(run, node); };
+    auto task = allocateShared<FuncTask<void, decltype(call)>>(std::move(call));
+    if (!run->pool_->trySubmitTask(task))
+    {
+        task->exec();
+    }
+}
+
+//执行一个节点 然后提交所有前驱都已经执行完的后继节点
+static void runNode(const std::shared_ptr<GraphRun>& run, size_t node)
+{
+    if (!run->failed_)
+    {
+        try
+        {
+            run->funcs_[node]();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(run->errorMtx_);
+            if (!run->error_)
+                run->error_ = std::current_exception();
+            run->failed_ = true;
+        }
+    }
+
+    for (size_t next : run->successors_[node])
+    {
+        if (run->pending_[next].fetch_sub(1) == 1)
+            submitNode(run, next);
+    }
+    if (run->remaining_.fetch_sub(1) == 1)
+    {
+        run->done_->exec();
+    }
+}
+
+//添加一个节点
+TaskGraph::Node TaskGraph::add(std::function<void()> func, std::initializer_list<Node> deps)
+{
+    for (Node dep : deps)
+    {
+        if (dep >= nodes_.size())
+            throw "task graph node out of range!";
+    }
+    Node node = nodes_.size();
+    nodes_.emplace_back();
+    nodes_.back().func_ = std::move(func);
+    for (Node dep : deps)
+    {
+        precede(dep, node);
+    }
+    return node;
+}
+
+//添加依赖
+void TaskGraph::precede(Node before, Node after)
+{
+    if (before >= nodes_.size() || after >= nodes_.size())
+        throw "task graph node out of range!";
+    nodes_[before].successors_.push_back(after);
+    nodes_[after].predecessors_++;
+}
+
+size_t TaskGraph::size() const
+{
+    return nodes_.size();
+}
+
+//按拓扑顺序遍历 不能遍历完所有节点说明有环
+bool TaskGraph::hasCycle() const
+{
+    std::vector<size_t> pending(nodes_.size());
+    std::vector<Node> ready;
+    for (Node i = 0; i < nodes_.size(); i++)
+    {
+        pending[i] = nodes_[i].predecessors_;
+        if (pending[i] == 0)
+            ready.push_back(i);
+    }
+    size_t visited = 0;
+    while (!ready.empty())
+    {
+        Node node = ready.back();
+        ready.pop_back();
+        visited++;
+        for (Node next : nodes_[node].successors_)
+        {
+            if (--pending[next] == 0)
+                ready.push_back(next);
+        }
+    }
+    return visited != nodes_.size();
+}
+
+//把整张图提交到线程池
+Result<void> TaskGraph::run(ThreadPool& pool) const
+{
+    if (hasCycle())
+        throw "task graph has a cycle!";
+
+    size_t count = nodes_.size();
+    auto state = std::make_shared<GraphRun>();
+    state->pool_ = pool.handle_;
+    state->funcs_.reserve(count);
+    state->successors_.reserve(count);
+    state->pending_.reset(new std::atomic<size_t>[count]);
+    for (size_t i = 0; i < count; i++)
+    {
+        state->funcs_.push_back(nodes_[i].func_);
+        state->successors_.push_back(nodes_[i].successors_);
+        state->pending_[i] = nodes_[i].predecessors_;
+    }
+    state->remaining_ = count;
+
+    //done_执行完后释放捕获的state 打破state和done_之间的循环引用
+    auto finish = [state]()
+    {
+        if (state->error_)
+            std::rethrow_exception(state->error_);
+    };
+    auto done = allocateShared<FuncTask<void, decltype(finish)>>(std::move(finish));
+    done->pool_ = pool.handle_;
+    state->done_ = done;
+
+    if (count == 0)
+    {
+        done->exec();
+    }
+    for (Node i = 0; i < count; i++)
+    {
+        if (nodes_[i].predecessors_ == 0)
+            submitNode(state, i);
+    }
+    return Result<void>(std::move(done), true);
+}
@@ -0,0 +1,62 @@
+/*任务依赖图 节点声明依赖关系 按依赖顺序提交到线程池*/
+
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <vector>
+#include <functional>
+#include <initializer_list>
+#include <stddef.h>
+
+#include "threadpool.h"
+
+/*
+每个节点的所有前驱执行完的那一刻 由执行最后一个前驱的线程把它提交到线程池
+阶段之间没有任何线程阻塞等待 一张图可以多次运行
+
+example:
+TaskGraph graph;
+auto load  = graph.add([]() { ... });
+auto left  = graph.add([]() { ... }, { load });
+auto right = graph.add([]() { ... }, { load });
+graph.add([]() { ... }, { left, right });
+Result<void> done = graph.run(pool);
+done.get();
+*/
+class TaskGraph
+{
+public:
+    using Node = size_t;
+
+    TaskGraph() = default;
+    ~TaskGraph() = default;
+
+    //添加一个节点 deps中的节点都执行完后才执行func
+    Node add(std::function<void()> func, std::initializer_list<Node> deps = {});
+
+    //添加依赖 before执行完后才执行after
+    void precede(Node before, Node after);
+
+    //节点数量
+    size_t size() const;
+
+    //把整张图提交到线程池 返回的Result在所有节点都结束后就绪
+    //任一节点抛出异常后 还没开始的节点不再执行 get重新抛出第一个异常
+    //图中有环时抛出异常
+    Result<void> run(ThreadPool& pool) const;
+
+private:
+    struct NodeInfo
+    {
+        std::function<void()> func_;
+        std::vector<Node> successors_; //依赖这个节点的节点
+        size_t predecessors_ = 0;      //这个节点依赖的节点数量
+    };
+
+    //检查图中是否有环
+    bool hasCycle() const;
+
+    std::vector<NodeInfo> nodes_;
+};
+
+#endif
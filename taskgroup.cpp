@@ -0,0 +1,301 @@
+#include "taskgroup.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <limits.h>
+
+static uint64_t groupNowNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//一个任务组的状态 由TaskGroup句柄、调度器的轮询表和组里还没执行完的任务共同持有
+//除了scheduler_ 所有成员都由调度器的mtx_保护
+struct GroupState
+{
+    struct Entry
+    {
+        std::shared_ptr<Task> task_;
+        uint64_t enqueueNs_;
+    };
+
+    std::shared_ptr<GroupScheduler> scheduler_;
+    std::deque<Entry> que_;
+    int weight_ = 1;
+    int maxConcurrency_ = INT_MAX;
+    int queueLimit_ = INT_MAX;
+    int running_ = 0;
+    int deficit_ = 0;      //本轮还能发出的任务数量
+    bool active_ = false;  //是否在轮询表里
+    std::shared_ptr<Completion> idle_; //组里没有任务时完成 有新任务时换一个新的
+
+    uint64_t submitted_ = 0;
+    uint64_t rejected_ = 0;
+    uint64_t completed_ = 0;
+    LatencyHistogram queueWait_;
+};
+
+//一个线程池的所有任务组共用的调度器 第一次创建任务组时创建
+class GroupScheduler
+{
+public:
+    explicit GroupScheduler(ThreadPool* pool)
+        : pool_(pool)
+    {}
+
+    //任务放入组队列 组队列满返回false
+    bool enqueue(const std::shared_ptr<GroupState>& group, std::shared_ptr<Task> task);
+
+    //按DRR从各组取任务交给线程池 直到交出去的任务达到上限或者没有可以调度的任务
+    void dispatch();
+
+    //线程池析构 之后提交到组的任务被拒绝 组队列里剩下的任务按被丢弃完成
+    void close();
+
+    std::mutex mtx_;
+
+private:
+    //组里的一个任务执行完
+    void taskDone(const std::shared_ptr<GroupState>& group);
+
+    //取下一个可以调度的任务 调用者必须持有mtx_
+    bool pick(std::shared_ptr<GroupState>& group, std::shared_ptr<Task>& task);
+
+    //交给线程池还没执行完的任务上限 线程数量的两倍 cache模式扩容后随之增加
+    int window() const
+    {
+        return std::max(2 * pool_->curThreadSize_.load(), 2);
+    }
+
+    ThreadPool* pool_; //关闭后为nullptr 由mtx_保护
+    std::deque<std::shared_ptr<GroupState>> active_; //有任务排队的组 轮询表的队头是当前服务的组
+    int dispatched_ = 0; //交给线程池还没执行完的任务数量
+};
+
+bool GroupScheduler::enqueue(const std::shared_ptr<GroupState>& group, std::shared_ptr<Task> task)
+{
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        if (pool_ == nullptr || (int)group->que_.size() >= group->queueLimit_)
+        {
+            group->rejected_++;
+            return false;
+        }
+        if (group->que_.empty() && group->running_ == 0)
+            group->idle_ = std::make_shared<Completion>();
+        group->que_.push_back(GroupState::Entry{ std::move(task), groupNowNs() });
+        group->submitted_++;
+        if (!group->active_)
+        {
+            //新加入轮询的组从队尾开始 差额从0开始 空闲期间不积累
+            group->active_ = true;
+            group->deficit_ = 0;
+            active_.push_back(group);
+        }
+    }
+    dispatch();
+    return true;
+}
+
+bool GroupScheduler::pick(std::shared_ptr<GroupState>& group, std::shared_ptr<Task>& task)
+{
+    size_t blocked = 0; //连续遇到的达到并发上限的组
+    while (!active_.empty() && blocked < active_.size())
+    {
+        std::shared_ptr<GroupState>& head = active_.front();
+        if (head->que_.empty())
+        {
+            head->active_ = false;
+            head->deficit_ = 0;
+            active_.pop_front();
+            continue;
+        }
+        if (head->running_ >= head->maxConcurrency_)
+        {
+            //保留剩下的差额 下次轮到时接着用
+            active_.push_back(std::move(head));
+            active_.pop_front();
+            blocked++;
+            continue;
+        }
+
+        //轮到这个组时补充一轮的额度 额度用完后移到队尾
+        if (head->deficit_ <= 0)
+            head->deficit_ += head->weight_;
+        head->deficit_--;
+        group = head;
+        GroupState::Entry& entry = group->que_.front();
+        task = std::move(entry.task_);
+        uint64_t now = groupNowNs();
+        group->queueWait_.record(now > entry.enqueueNs_ ? now - entry.enqueueNs_ : 0);
+        group->que_.pop_front();
+        group->running_++;
+        if (group->deficit_ <= 0 || group->que_.empty())
+        {
+            active_.push_back(std::move(head));
+            active_.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void GroupScheduler::dispatch()
+{
+    std::vector<std::pair<std::shared_ptr<GroupState>, std::shared_ptr<Task>>> picked;
+    ThreadPool* pool;
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        pool = pool_;
+        if (pool == nullptr)
+            return;
+        int limit = window();
+        std::shared_ptr<GroupState> group;
+        std::shared_ptr<Task> task;
+        while (dispatched_ < limit && pick(group, task))
+        {
+            dispatched_++;
+            picked.emplace_back(std::move(group), std::move(task));
+        }
+    }
+
+    //不持有锁交给线程池 任务执行完的回调再次调度
+    //工作窃取模式下也放入全局队列 执行完一个任务的线程调度的下一个任务如果放入它的本地队列(LIFO)
+    //早先调度的任务会一直压在下面 调度的顺序就没有意义了
+    //队列满提交失败时在当前线程直接执行 保证组里的任务不会丢失
+    ThreadPool::Admission admission;
+    admission.global_ = true;
+    for (auto& item : picked)
+    {
+        std::shared_ptr<GroupState> group = std::move(item.first);
+        std::shared_ptr<Task>& task = item.second;
+        task->addContinuation([this, group]() { taskDone(group); });
+        if (!pool->enqueueTask(task, admission))
+            task->exec();
+    }
+}
+
+void GroupScheduler::close()
+{
+    //工作线程退出前组队列已经随任务完成一路调度完 这里通常没有剩下的任务
+    std::vector<std::shared_ptr<Task>> dropped;
+    std::vector<std::shared_ptr<Completion>> idles;
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        pool_ = nullptr;
+        for (std::shared_ptr<GroupState>& group : active_)
+        {
+            for (GroupState::Entry& entry : group->que_)
+                dropped.push_back(std::move(entry.task_));
+            group->que_.clear();
+            group->active_ = false;
+            if (group->running_ == 0)
+                idles.push_back(group->idle_);
+        }
+        active_.clear();
+    }
+    for (std::shared_ptr<Task>& task : dropped)
+    {
+        task->dropped_ = true;
+        task->complete();
+    }
+    for (std::shared_ptr<Completion>& idle : idles)
+        idle->set();
+}
+
+void closeGroupScheduler(GroupScheduler* scheduler)
+{
+    scheduler->close();
+}
+
+void GroupScheduler::taskDone(const std::shared_ptr<GroupState>& group)
+{
+    std::shared_ptr<Completion> idle;
+    {
+        std::lock_guard<std::mutex> guard(mtx_);
+        dispatched_--;
+        group->running_--;
+        group->completed_++;
+        if (group->que_.empty() && group->running_ == 0)
+            idle = group->idle_;
+    }
+    if (idle != nullptr)
+        idle->set();
+    dispatch();
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool, int weight)
+    : state_(std::make_shared<GroupState>())
+{
+    {
+        //调度器和线程池一起存在 第一次创建任务组时创建
+        std::lock_guard<std::mutex> guard(pool.taskQueMtx_);
+        if (pool.groupScheduler_ == nullptr)
+            pool.groupScheduler_ = std::make_shared<GroupScheduler>(&pool);
+        state_->scheduler_ = pool.groupScheduler_;
+    }
+    state_->weight_ = std::max(weight, 1);
+    state_->idle_ = std::make_shared<Completion>();
+    state_->idle_->set();
+}
+
+void TaskGroup::setWeight(int weight)
+{
+    std::lock_guard<std::mutex> guard(state_->scheduler_->mtx_);
+    state_->weight_ = std::max(weight, 1);
+}
+
+void TaskGroup::setMaxConcurrency(int limit)
+{
+    {
+        std::lock_guard<std::mutex> guard(state_->scheduler_->mtx_);
+        state_->maxConcurrency_ = limit < 1 ? INT_MAX : limit;
+    }
+    //上限调大后可能有任务可以调度了
+    state_->scheduler_->dispatch();
+}
+
+void TaskGroup::setQueueLimit(int limit)
+{
+    std::lock_guard<std::mutex> guard(state_->scheduler_->mtx_);
+    state_->queueLimit_ = limit < 1 ? INT_MAX : limit;
+}
+
+Result<> TaskGroup::submitTask(std::shared_ptr<Task> sp)
+{
+    bool isValid = enqueue(sp);
+    return Result<>(std::move(sp), isValid);
+}
+
+bool TaskGroup::enqueue(std::shared_ptr<Task> task)
+{
+    return state_->scheduler_->enqueue(state_, std::move(task));
+}
+
+void TaskGroup::wait()
+{
+    std::shared_ptr<Completion> idle;
+    {
+        std::lock_guard<std::mutex> guard(state_->scheduler_->mtx_);
+        idle = state_->idle_;
+    }
+    helpWait(*idle);
+}
+
+TaskGroupStats TaskGroup::stats() const
+{
+    TaskGroupStats result;
+    std::lock_guard<std::mutex> guard(state_->scheduler_->mtx_);
+    result.weight = state_->weight_;
+    result.maxConcurrency = state_->maxConcurrency_ == INT_MAX ? 0 : state_->maxConcurrency_;
+    result.queued = (int)state_->que_.size();
+    result.running = state_->running_;
+    result.submitted = state_->submitted_;
+    result.rejected = state_->rejected_;
+    result.completed = state_->completed_;
+    result.queueWait = state_->queueWait_;
+    return result;
+}
@@ -0,0 +1,85 @@
+/*任务组 多个租户共享一个线程池 按权重公平地分配工作线程*/
+
+#ifndef TASKGROUP_H
+#define TASKGROUP_H
+
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "threadpool.h"
+#include "poolstats.h"
+
+class GroupScheduler;
+struct GroupState;
+
+/*
+直接提交到线程池的任务按到达顺序执行 一个租户大量提交时会占满所有工作线程和整个任务队列
+提交到任务组的任务先放在组自己的队列里 同一个线程池的所有组共用一个调度器
+调度器按差额轮询(DRR)从各组取任务交给线程池：每轮每个组可以发出weight个任务 权重越大分到的工作线程越多
+交给线程池还没执行完的任务总数不超过线程数量的两倍 任务队列不会被某一个组占满 新来的组很快就能轮到
+组内按提交顺序执行 同时执行的任务不超过maxConcurrency 组队列满时提交失败
+
+TaskGroup是句柄 复制后指向同一个组 所有句柄销毁后已经提交的任务照常执行
+线程池析构时等待所有组队列里的任务执行完 之后关闭调度器 句柄可以比线程池活得久 但再提交的任务都失败
+
+example:
+TaskGroup batch(pool, 1);
+TaskGroup online(pool, 4);
+online.setMaxConcurrency(8);
+Result<int> res = online.submit([](int a) { return a * 2; }, 21);
+batch.submit(rebuildIndex);
+batch.wait();
+*/
+class TaskGroup
+{
+public:
+    //weight是调度权重 至少为1
+    explicit TaskGroup(ThreadPool& pool, int weight = 1);
+    ~TaskGroup() = default;
+
+    //设置调度权重 至少为1
+    void setWeight(int weight);
+
+    //设置组内同时执行的任务上限 小于1表示不限制(默认)
+    void setMaxConcurrency(int limit);
+
+    //设置组队列的上限 小于1表示不限制(默认) 只影响之后的提交
+    void setQueueLimit(int limit);
+
+    //提交任务 组队列满时返回无效的Result
+    Result<> submitTask(std::shared_ptr<Task> sp);
+
+    //提交任意可调用对象和参数 返回带类型的Result<T>
+    template<typename Func, typename... Args>
+    auto submit(Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        using RType = typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type;
+        auto call = [func = std::forward<Func>(func), args = std::make_tuple(std::forward<Args>(args)...)]() mutable -> RType
+        {
+            return std::apply(func, std::move(args));
+        };
+        auto task = allocateShared<FuncTask<RType, decltype(call)>>(std::move(call));
+        bool isValid = enqueue(task);
+        return Result<RType>(std::move(task), isValid);
+    }
+
+    //等待组里已经提交的任务全部执行完 工作线程上调用时等待期间执行排队的任务
+    void wait();
+
+    //组的统计快照
+    TaskGroupStats stats() const;
+
+private:
+    //任务放入组队列并尝试调度 组队列满返回false
+    bool enqueue(std::shared_ptr<Task> task);
+
+    std::shared_ptr<GroupState> state_;
+};
+
+//线程池析构时调用 关闭调度器 之后组不再访问线程池
+void closeGroupScheduler(GroupScheduler* scheduler);
+
+#endif
@@ -1,14 +1,223 @@
 #include "threadpool.h"
+#include "taskgroup.h"
+#include "ringqueue.h"
+#include "logger.h"
+#include "topology.h"
 #include <functional>
-#include <iostream>
 #include <vector>
 #include <stddef.h>
 #include <thread>
+#include <deque>
+#include <map>
+#include <algorithm>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#endif
 
 
 const int TASK_MAX_THRESHHOLD = INT32_MAX;
 const int THREAD_MAX_THRESHHOLD = 1024;
-const int THREAD_MAX_IDLE_TIME = 60;
+const int THREAD_MAX_IDLE_TIME = 60; //cache模式下多余线程默认的保活时间 秒
+const int TARGET_QUEUE_WAIT_US = 1000; //cache模式下默认可以接受的排队时间 微秒
+const int CONTROL_INTERVAL_MS = 10; //有任务排队时控制线程的采样间隔 毫秒
+const int RING_MAX_CAPACITY = 1 << 16; //无锁队列最大容量 任务队列上限阈值超过时按这个值截断
+const int PRIORITY_BAND_COUNT = 3; //优先级的数量 与TaskPriority对应
+const uint64_t PRIORITY_AGING_NS = 100000000; //低优先级任务默认的老化时间 100毫秒
+const int TIMER_TICK_US = 1000; //时间轮的刻度 微秒 定时器最多晚这么久到期
+const int SPARE_THREAD_KEEPALIVE_MS = 1000; //备用的补偿线程的保活时间 毫秒
+
+//工作窃取模式下每个线程私有的双端队列
+//本线程从队尾存取(LIFO 刚产生的子任务数据还在缓存里) 其他线程从队头窃取(FIFO 先窃取较早较大的任务)
+//每个队列一把锁 只有本线程和偶尔的窃取者竞争 不再所有线程都抢taskQueMtx_
+class WorkStealQueue
+{
+public:
+    std::mutex mtx_;
+    TaskDeque que_;
+};
+
+//带优先级或截止时间的任务队列 由taskQueMtx_保护
+//每个优先级一张按(截止时间, 提交顺序)排序的有序表 截止时间早的先取(EDF) 没有截止时间的按提交顺序排在最后
+//低优先级另外按提交顺序记录到达时间 用于老化：等待超过老化时间的任务按提交顺序先于普通优先级取出
+class PriorityTaskQueue
+{
+public:
+    void push(std::shared_ptr<Task> task, int band, uint64_t deadline, uint64_t now, uint64_t agingNs)
+    {
+        Key key{ deadline, nextSeq_++ };
+        Band& b = bands_[band];
+        b.tasks_.emplace(key, std::move(task));
+        if (band == (int)TaskPriority::PRIORITY_LOW && agingNs > 0)
+        {
+            b.arrivals_.emplace_back(now, key);
+        }
+    }
+
+    //按 高优先级 -> 老化的低优先级 -> 普通优先级 -> 低优先级(lowBand) 的顺序取一个任务
+    bool pop(std::shared_ptr<Task>& task, uint64_t now, uint64_t agingNs, bool lowBand)
+    {
+        if (popFront(bands_[(int)TaskPriority::PRIORITY_HIGH], task))
+            return true;
+
+        Band& low = bands_[(int)TaskPriority::PRIORITY_LOW];
+        while (!low.arrivals_.empty())
+        {
+            //已经按截止时间顺序取走的任务 到达记录在这里顺便清掉
+            auto it = low.tasks_.find(low.arrivals_.front().second);
+            if (it == low.tasks_.end())
+            {
+                low.arrivals_.pop_front();
+                continue;
+            }
+            if (now - low.arrivals_.front().first < agingNs)
+                break;
+            task = std::move(it->second);
+            low.tasks_.erase(it);
+            low.arrivals_.pop_front();
+            return true;
+        }
+
+        if (popFront(bands_[(int)TaskPriority::PRIORITY_NORMAL], task))
+            return true;
+        return lowBand && popFront(low, task);
+    }
+
+private:
+    struct Key
+    {
+        uint64_t deadline_;
+        uint64_t seq_;
+        bool operator<(const Key& other) const
+        {
+            return deadline_ != other.deadline_ ? deadline_ < other.deadline_ : seq_ < other.seq_;
+        }
+    };
+
+    struct Band
+    {
+        std::map<Key, std::shared_ptr<Task>, std::less<Key>,
+            PoolAllocator<std::pair<const Key, std::shared_ptr<Task>>>> tasks_;
+        std::deque<std::pair<uint64_t, Key>, PoolAllocator<std::pair<uint64_t, Key>>> arrivals_; //(到达时间, 任务) 只有低优先级并且开启老化时记录
+    };
+
+    static bool popFront(Band& band, std::shared_ptr<Task>& task)
+    {
+        if (band.tasks_.empty())
+            return false;
+        auto it = band.tasks_.begin();
+        task = std::move(it->second);
+        band.tasks_.erase(it);
+        return true;
+    }
+
+    Band bands_[PRIORITY_BAND_COUNT];
+    uint64_t nextSeq_ = 0; //提交顺序 截止时间相同时先提交的先取
+};
+
+//单个线程写、其他线程读的计数器 只有所属线程修改 不需要原子的读改写指令
+class StatCounter
+{
+public:
+    void add(uint64_t n = 1)
+    {
+        value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    uint64_t get() const
+    {
+        return value_.load(std::memory_order_relaxed);
+    }
+private:
+    std::atomic<uint64_t> value_{ 0 };
+};
+
+//单个线程写的直方图 读取时合并到LatencyHistogram
+class StatHistogram
+{
+public:
+    void record(uint64_t value)
+    {
+        counts_[LatencyHistogram::bucketIndex(value)].add();
+        sum_.add(value);
+        if (value > max_.get())
+            max_.add(value - max_.get());
+    }
+    void mergeTo(LatencyHistogram& histogram) const
+    {
+        for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; i++)
+        {
+            uint64_t count = counts_[i].get();
+            if (count > 0)
+                histogram.addBucket(i, count);
+        }
+        histogram.addSummary(sum_.get(), max_.get());
+    }
+private:
+    StatCounter counts_[LatencyHistogram::BUCKET_COUNT];
+    StatCounter sum_;
+    StatCounter max_;
+};
+
+//一个线程在一个线程池里的全部统计 按缓存行对齐 不同线程的计数不会共享缓存行
+class alignas(CACHE_LINE_SIZE) StatsBlock
+{
+public:
+    StatCounter submitted_;
+    StatCounter rejected_;
+    StatCounter callerRuns_;
+    StatCounter dropped_;
+    StatCounter expired_;
+    StatCounter completed_;
+    StatCounter threadsCreated_;
+    StatCounter threadsReaped_;
+    StatCounter steals_;
+    StatCounter parks_;
+    StatCounter helped_;
+    StatCounter compensated_;
+    StatHistogram queueWait_;
+    StatHistogram runTime_;
+};
+
+//线程池编号 不复用 避免线程池析构后新线程池分配到同一地址时用错统计计数
+static std::atomic<uint64_t> nextPoolId(1);
+
+//当前线程在各个线程池里的统计计数 只缓存最近使用的几个线程池
+struct LocalStats
+{
+    uint64_t poolId_;
+    StatsBlock* block_;
+};
+const size_t LOCAL_STATS_CACHE_SIZE = 16;
+thread_local std::vector<LocalStats> tlsStats;
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//自旋等待时降低CPU功耗和对超线程兄弟核的干扰
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+//当前线程所属的工作窃取线程池以及它的本地队列 非线程池线程为nullptr
+thread_local ThreadPool* tlsStealPool = nullptr;
+thread_local WorkStealQueue* tlsLocalQue = nullptr;
+
+//当前线程所属的线程池(所有模式)以及线程所在的节点 等待结果时据此执行排队的任务
+thread_local ThreadPool* tlsWorkerPool = nullptr;
+thread_local int tlsWorkerNode = 0;
+
+//当前线程嵌套的阻塞区域层数 只有最外层通知线程池
+thread_local int tlsBlockingDepth = 0;
 
 /* 线程池构造 */
 ThreadPool::ThreadPool()
@@ -20,245 +229,1781 @@ ThreadPool::ThreadPool()
     , threadSizeThreshHold_(THREAD_MAX_THRESHHOLD)
     , poolMode_(PoolMode::MODE_FIXED)
     , isPoolRunning_(false)
+    , injectTaskSize_(0)
+    , sleepThreadSize_(0)
+    , taskQueMode_(TaskQueMode::QUE_LOCKED)
+    , spinCount_(0)
+    , prioQue_(std::make_unique<PriorityTaskQueue>())
+    , prioTaskSize_(0)
+    , agingNs_(PRIORITY_AGING_NS)
+    , dropExpired_(false)
+    , rejectPolicy_(RejectPolicy::REJECT_BLOCK)
+    , blockTime_(std::chrono::seconds(1))
+    , affinity_(ThreadAffinity::AFFINITY_NONE)
+    , numaAware_(false)
+    , placeIndex_(0)
+    , nodeTaskSize_(0)
+    , minThreadSize_(-1)
+    , keepAlive_(std::chrono::seconds(THREAD_MAX_IDLE_TIME))
+    , targetWait_(TARGET_QUEUE_WAIT_US)
+    , ctrlSignaled_(false)
+    , retireThreadSize_(0)
+    , minIdleThreadSize_(0)
+    , timerWakeTick_(UINT64_MAX)
+    , timerExit_(false)
+    , blockedThreadSize_(0)
+    , compThreadSize_(0)
+    , spareThreadSize_(0)
+    , spareWakeSize_(0)
+    , handle_(std::make_shared<PoolHandle>(this))
+    , poolId_(nextPoolId++)
+    , taskTiming_(false)
 {}
 
 /* 线程池析构 */
 ThreadPool::~ThreadPool()
 {
+    //先关闭共享句柄 之后完成的任务的后续回调在当前线程直接执行 不会在工作线程退出后留在队列里 也不会访问已经析构的线程池
+    //攒批等通过句柄使用定时器的对象也不会在定时器线程停止后再添加定时器
+    handle_->close();
+
+    //停止定时器线程 丢弃的任务的后续回调在当前线程执行
+    stopTimers();
+
     isPoolRunning_ = false;
     //notEmpty_.notify_all();
 
-    //等待池子里所有线程返回：阻塞线程 执行中线程
-    std::unique_lock<std::mutex> lock(taskQueMtx_);
-    notEmpty_.notify_all();
-    exitCond_.wait(lock, [&]()->bool {return threads_.size() == 0; });
+    //先停止控制线程 之后不会再创建新线程
+    {
+        std::lock_guard<std::mutex> guard(ctrlMtx_);
+        ctrlCond_.notify_all();
+    }
+    //备用的补偿线程直接退出
+    {
+        std::lock_guard<std::mutex> guard(compMtx_);
+        compCond_.notify_all();
+    }
+    if (controller_.joinable())
+        controller_.join();
+
+    //等待池子里所有线程返回：阻塞线程 执行中线程
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    //控制线程已经停止 还没被认领的回收名额作废 被唤醒的线程按退出流程返回
+    retireThreadSize_ = 0;
+    notEmpty_.notify_all();
+    exitCond_.wait(lock, [&]()->bool {return threads_.size() == 0; });
+    lock.unlock();
+
+    //组队列里的任务已经随工作线程执行完 关闭调度器 之后还在使用的TaskGroup句柄提交失败 不再访问线程池
+    if (groupScheduler_ != nullptr)
+        closeGroupScheduler(groupScheduler_.get());
+}
+
+//设置线程池工作模式
+void ThreadPool::setMode(PoolMode mode)
+{
+    if (checkRunningState())
+        return;
+    poolMode_ = mode;
+}
+
+/*设置初始线程数量
+void ThreadPool::setInitThreadSize(int size)
+{
+    initThreadSize_ = size;
+}
+*/
+
+//设置空闲线程睡眠前的自旋次数
+void ThreadPool::setSpinCount(int count)
+{
+    if (checkRunningState())
+        return;
+    spinCount_ = count;
+}
+
+//设置task任务队列上限阈值
+void ThreadPool::settaskQueMaxThreshHold(int threshhold)
+{
+    if (checkRunningState())
+        return;
+    taskQueMaxThreshHold_ = threshhold;
+}
+//设置任务队列满时的拒绝策略
+void ThreadPool::setRejectPolicy(RejectPolicy policy, std::chrono::milliseconds blockTime)
+{
+    if (checkRunningState())
+        return;
+    rejectPolicy_ = policy;
+    blockTime_ = blockTime;
+}
+//设置任务队列的实现方式
+void ThreadPool::settaskQueMode(TaskQueMode mode)
+{
+    if (checkRunningState())
+        return;
+    taskQueMode_ = mode;
+}
+//设置线程数量上限阈值
+void ThreadPool::setthreadSizeThreshHold(int threshhold)
+{
+    if (checkRunningState())
+        return;
+    threadSizeThreshHold_ = threshhold;
+}
+//设置cache模式下保留的最少线程数量
+void ThreadPool::setMinThreadSize(int size)
+{
+    if (checkRunningState())
+        return;
+    minThreadSize_ = size;
+}
+//设置cache模式下多余线程的保活时间
+void ThreadPool::setThreadKeepAlive(std::chrono::milliseconds keepAlive)
+{
+    if (checkRunningState())
+        return;
+    keepAlive_ = keepAlive;
+}
+//设置cache模式下可以接受的排队时间
+void ThreadPool::setTargetQueueWait(std::chrono::microseconds wait)
+{
+    if (checkRunningState())
+        return;
+    targetWait_ = wait;
+}
+//设置低优先级任务的老化时间
+void ThreadPool::setPriorityAging(std::chrono::milliseconds aging)
+{
+    if (checkRunningState())
+        return;
+    agingNs_ = aging.count() > 0
+        ? (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(aging).count() : 0;
+}
+//设置是否丢弃超过截止时间的任务
+void ThreadPool::setDropExpiredTasks(bool enable)
+{
+    if (checkRunningState())
+        return;
+    dropExpired_ = enable;
+}
+//设置线程绑核方式
+void ThreadPool::setThreadAffinity(ThreadAffinity affinity, const std::vector<int>& cpus)
+{
+    if (checkRunningState())
+        return;
+    affinity_ = affinity;
+    affinityCpus_ = cpus;
+}
+//设置是否开启NUMA感知
+void ThreadPool::setNumaAware(bool enable)
+{
+    if (checkRunningState())
+        return;
+    numaAware_ = enable;
+}
+
+//给线程池提交任务   用户调用该接口，传入任务对象，生产任务
+Result<> ThreadPool::submitTask(std::shared_ptr<Task> sp)//让用户直接传智能指针进来，规避生命周期太短的任务。
+{
+    //返回值存放在task里 Result只是共同持有task 先入队再构造Result也不会丢失返回值
+    bool isValid = enqueueTask(sp, policyAdmission());
+    //返回任务的result对象
+    return Result<>(std::move(sp), isValid);
+}
+
+//尝试提交任务 不使用拒绝策略
+Result<> ThreadPool::trySubmitTask(std::shared_ptr<Task> sp, std::chrono::nanoseconds timeout)
+{
+    Admission admission;
+    admission.timeout_ = timeout;
+    bool isValid = enqueueTask(sp, admission);
+    return Result<>(std::move(sp), isValid);
+}
+
+//按优先级提交任务
+Result<> ThreadPool::submitTask(std::shared_ptr<Task> sp, TaskPriority priority,
+    std::chrono::steady_clock::time_point deadline)
+{
+    setTaskPriority(sp.get(), priority, deadline);
+    bool isValid = enqueueTask(sp, policyAdmission());
+    return Result<>(std::move(sp), isValid);
+}
+
+//带截止时间提交任务
+Result<> ThreadPool::submitTask(std::shared_ptr<Task> sp, std::chrono::steady_clock::time_point deadline)
+{
+    return submitTask(std::move(sp), TaskPriority::PRIORITY_NORMAL, deadline);
+}
+
+//带NUMA节点提示提交任务
+Result<> ThreadPool::submitTask(std::shared_ptr<Task> sp, int node)
+{
+    sp->node_ = node;
+    bool isValid = enqueueTask(sp, policyAdmission());
+    return Result<>(std::move(sp), isValid);
+}
+
+//记录任务的优先级和截止时间
+void ThreadPool::setTaskPriority(Task* task, TaskPriority priority, std::chrono::steady_clock::time_point deadline)
+{
+    task->priority_ = priority;
+    task->deadline_ = deadline == std::chrono::steady_clock::time_point::max()
+        ? UINT64_MAX : (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+}
+
+//按拒绝策略确定入队的处理方式
+ThreadPool::Admission ThreadPool::policyAdmission() const
+{
+    Admission admission;
+    switch (rejectPolicy_)
+    {
+    case RejectPolicy::REJECT_CALLER_RUNS:
+        admission.callerRuns_ = true;
+        break;
+    case RejectPolicy::REJECT_DISCARD_OLDEST:
+        admission.dropOldest_ = true;
+        break;
+    case RejectPolicy::REJECT_BLOCK:
+        admission.timeout_ = blockTime_;
+        break;
+    default:
+        break;
+    }
+    return admission;
+}
+
+PoolHandle::PoolHandle(ThreadPool* pool)
+    : pool_(pool)
+{}
+
+//提交期间共享持有锁 线程池的析构函数关闭句柄时等待提交结束
+bool PoolHandle::trySubmitTask(const std::shared_ptr<Task>& sp)
+{
+    std::shared_lock<std::shared_mutex> lock(mtx_);
+    return pool_ != nullptr && pool_->enqueueTask(sp);
+}
+
+void PoolHandle::close()
+{
+    std::unique_lock<std::shared_mutex> lock(mtx_);
+    pool_ = nullptr;
+}
+
+//任务入队并计数
+bool ThreadPool::enqueueTask(std::shared_ptr<Task> sp, const Admission& admission)
+{
+    sp->enqueueTime_ = taskTiming_ ? nowNs() : 0;
+    //同一个任务再次提交时不重复增加句柄的引用计数
+    if (sp->pool_ != handle_)
+        sp->pool_ = handle_;
+    sp->droppable_ = admission.dropOldest_;
+    sp->runState_.store(Task::RUN_IDLE, std::memory_order_relaxed);
+    //入队失败时还要用到任务
+    Task* task = sp.get();
+    //普通优先级并且没有截止时间的任务走原来的队列 不受优先级队列的影响
+    bool isValid;
+    if (sp->priority_ != TaskPriority::PRIORITY_NORMAL || sp->deadline_ != UINT64_MAX)
+        isValid = pushPriorityTask(std::move(sp), admission);
+    else if (sp->node_ >= 0 && sp->node_ < (int)nodeQues_.size())
+        isValid = pushNodeTask(std::move(sp), admission);
+    else
+        isValid = pushTask(std::move(sp), admission);
+    StatsBlock* stats = localStats();
+    if (isValid)
+    {
+        task->markQueued();
+        stats->submitted_.add();
+        wakeHelpers();
+    }
+    else if (admission.callerRuns_)
+    {
+        //队列满 提交任务的线程自己执行 提交方被拖慢 提交速度自然降下来
+        task->exec();
+        stats->callerRuns_.add();
+        isValid = true;
+    }
+    else
+    {
+        stats->rejected_.add();
+    }
+    return isValid;
+}
+
+//预留一个队列位置
+bool ThreadPool::reserveTask(std::unique_lock<std::mutex>& lock, const Admission& admission)
+{
+    bool locked = lock.owns_lock();
+    bool waited = false;
+    std::chrono::steady_clock::time_point deadline;
+    //预留成功后队列一定放得下 有锁队列、环形队列(容量是上限阈值的两倍 槽位释放得晚时见pushRing)和其他队列都一样
+    while (taskSize_.fetch_add(1) >= taskQueMaxThreshHold_)
+    {
+        taskSize_--;
+        if (admission.dropOldest_ && dropOldestTask(lock))
+            continue;
+        if (admission.timeout_.count() <= 0)
+            return false;
+
+        //只在队列满需要等待时才取当前时间
+        if (!waited)
+        {
+            waited = true;
+            deadline = std::chrono::steady_clock::now() + admission.timeout_;
+        }
+        if (!lock.owns_lock())
+            lock.lock();
+        if (!notFull_.wait_until(lock, deadline,
+            [&]()->bool { return taskSize_ < taskQueMaxThreshHold_; }))
+        {
+            //等待超时仍然不能满足notfull条件
+            POOL_LOG_WARN("task queue is full, task submit fail.");
+            if (!locked)
+                lock.unlock();
+            return false;
+        }
+        if (!locked)
+            lock.unlock();
+    }
+    return true;
+}
+
+//工作窃取模式下放入本地队列前预留count个位置 放不下时不等待也不淘汰 由调用者走全局队列按admission处理
+//先检查再加计数的话 多个线程同时提交会超过上限阈值
+bool ThreadPool::reserveLocal(int count)
+{
+    int curSize = taskSize_;
+    while (curSize + (int64_t)count <= taskQueMaxThreshHold_)
+    {
+        if (taskSize_.compare_exchange_weak(curSize, curSize + count))
+            return true;
+    }
+    return false;
+}
+
+//批量入队时预留位置 本地队列和节点队列的预留不持有taskQueMtx_ 先读再加会超过上限阈值
+//reserveTask的fetch_add可能让计数短暂超过阈值 此时剩余位置按0算
+size_t ThreadPool::reserveBatch(size_t count)
+{
+    int curSize = taskSize_;
+    size_t accepted;
+    do
+    {
+        accepted = std::min(count, (size_t)std::max(taskQueMaxThreshHold_ - curSize, 0));
+    } while (accepted > 0 && !taskSize_.compare_exchange_weak(curSize, curSize + (int)accepted));
+    return accepted;
+}
+
+//淘汰全局队列中最早的任务
+//可以淘汰的任务直接完成 它的Result变为无效 线程池内部依赖的任务(后续任务、任务图节点、并行算法拆出的任务)
+//不能丢弃 由当前线程执行 完成或者执行任务时都不持有锁 任务的后续回调可能会再次提交任务
+bool ThreadPool::dropOldestTask(std::unique_lock<std::mutex>& lock)
+{
+    bool locked = lock.owns_lock();
+    std::shared_ptr<Task> victim;
+    if (ringQue_ == nullptr && !locked)
+        lock.lock();
+    bool popped = popGlobalTask(victim);
+    if (lock.owns_lock())
+        lock.unlock();
+
+    if (popped)
+    {
+        //淘汰的任务让出的位置由当前线程接着预留 不通知notFull_
+        taskSize_--;
+        if (victim->runState_.exchange(Task::RUN_STARTED) == Task::RUN_STARTED)
+        {
+            //等待它的工作线程已经直接执行了 只是让出位置
+        }
+        else if (victim->droppable_)
+        {
+            POOL_LOG_DEBUG("task queue is full, oldest task dropped.");
+            victim->dropped_ = true;
+            victim->complete();
+            localStats()->dropped_.add();
+        }
+        else
+        {
+            victim->exec();
+            localStats()->callerRuns_.add();
+        }
+    }
+    if (locked)
+        lock.lock();
+    return popped;
+}
+
+//把任务放入合适的队列
+bool ThreadPool::pushTask(std::shared_ptr<Task> sp, const Admission& admission)
+{
+    //工作窃取模式下 池内线程提交的子任务直接放入自己的本地队列 不竞争全局锁
+    //队列已满时走下面的全局队列路径 按admission处理
+    if (tlsStealPool == this && !admission.global_ && reserveLocal(1))
+    {
+        {
+            std::lock_guard<std::mutex> localGuard(tlsLocalQue->mtx_);
+            tlsLocalQue->que_.emplace_back(std::move(sp));
+        }
+
+        //有线程在睡眠才需要加锁唤醒 sleepThreadSize_和taskSize_都是顺序一致的原子操作 不会丢失唤醒
+        if (sleepThreadSize_ > 0)
+        {
+            std::lock_guard<std::mutex> guard(taskQueMtx_);
+            notEmpty_.notify_one();
+        }
+        return true;
+    }
+
+    if (ringQue_ != nullptr)
+    {
+        return enqueueRingTask(std::move(sp), admission);
+    }
+
+    //获取锁
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+
+    //线程通信--等待任务队列有空余节点
+    /*基本实现
+    while (taskQue_.size() == taskQueMaxThreshHold_)
+    {
+        notFull_.wait(lock);//改变线程状态
+    }
+    */
+    //队列满时按拒绝策略等待或者淘汰任务 不再固定阻塞用户线程一秒
+    if (!reserveTask(lock, admission))
+    {
+        return false;
+    }
+    //若有空余，任务放入任务队列
+    taskQue_.emplace(std::move(sp));
+    injectTaskSize_++;
+
+    //放入任务后，只唤醒一个睡眠的线程来执行 其他线程继续睡眠 避免惊群
+    wakeThreads(1);
+
+    //cache模式 任务数量超过空闲线程数量时通知控制线程扩容
+    requestThreads();
+    return true;
+}
+
+//无锁队列模式下任务入队
+bool ThreadPool::enqueueRingTask(std::shared_ptr<Task> sp, const Admission& admission)
+{
+    //先用taskSize_预留一个位置 队列满需要等待时才加锁
+    std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+    if (!reserveTask(lock, admission))
+    {
+        return false;
+    }
+
+    pushRing(std::move(sp));
+    //有线程在睡眠才需要加锁唤醒
+    if (sleepThreadSize_ > 0)
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        notEmpty_.notify_one();
+    }
+    //cache模式 任务数量超过空闲线程数量时通知控制线程扩容
+    requestThreads();
+    return true;
+}
+
+//已经预留了位置的任务放入环形队列
+//预留位置的计数和槽位不是同时释放的：取走任务的线程可能已经减了taskSize_ 还没把槽位标记为空
+//这时push暂时失败 等那个线程释放槽位后重试 任务不能丢弃
+void ThreadPool::pushRing(std::shared_ptr<Task> sp)
+{
+    while (!ringQue_->push(std::move(sp)))
+    {
+        std::this_thread::yield();
+    }
+}
+
+//带优先级或截止时间的任务入队 所有队列模式下都放入由taskQueMtx_保护的优先级队列
+bool ThreadPool::pushPriorityTask(std::shared_ptr<Task> sp, const Admission& admission)
+{
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    //和无锁队列一样用taskSize_预留位置 与其他队列里的任务一起不超过上限阈值
+    if (!reserveTask(lock, admission))
+    {
+        return false;
+    }
+
+    int band = (int)sp->priority_;
+    uint64_t deadline = sp->deadline_;
+    prioQue_->push(std::move(sp), band, deadline, agingNs_ > 0 ? nowNs() : 0, agingNs_);
+    prioTaskSize_++;
+    wakeThreads(1);
+
+    //cache模式 任务数量超过空闲线程数量时通知控制线程扩容
+    requestThreads();
+    return true;
+}
+
+//带节点提示的任务放入节点队列
+bool ThreadPool::pushNodeTask(std::shared_ptr<Task> sp, const Admission& admission)
+{
+    //和无锁队列一样先用taskSize_预留位置 队列满需要等待时才加锁
+    std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+    if (!reserveTask(lock, admission))
+    {
+        return false;
+    }
+
+    WorkStealQueue* que = nodeQues_[sp->node_].get();
+    {
+        std::lock_guard<std::mutex> guard(que->mtx_);
+        que->que_.emplace_back(std::move(sp));
+    }
+    nodeTaskSize_++;
+
+    //被唤醒的线程不一定在这个节点上 本节点的线程都在忙时由它执行
+    if (sleepThreadSize_ > 0)
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        notEmpty_.notify_one();
+    }
+    //cache模式 任务数量超过空闲线程数量时通知控制线程扩容
+    requestThreads();
+    return true;
+}
+
+//从节点队列取一个任务
+bool ThreadPool::popNodeTask(std::shared_ptr<Task>& task, int node, bool remote)
+{
+    if (nodeTaskSize_ <= 0)
+        return false;
+    size_t nodeCount = nodeQues_.size();
+    for (size_t i = remote ? 1 : 0; i < (remote ? nodeCount : 1); i++)
+    {
+        WorkStealQueue* que = nodeQues_[(node + i) % nodeCount].get();
+        std::lock_guard<std::mutex> guard(que->mtx_);
+        if (!que->que_.empty())
+        {
+            task = std::move(que->que_.front());
+            que->que_.pop_front();
+            nodeTaskSize_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+//线程启动时绑定CPU
+int ThreadPool::placeCurrentThread()
+{
+    bool numa = nodeQues_.size() > 1;
+    if (affinity_ == ThreadAffinity::AFFINITY_NONE && !numa)
+        return 0;
+
+    const CpuTopology& topology = CpuTopology::instance();
+    int index = placeIndex_++;
+    int node = -1;
+    std::vector<int> cpus = affinityCpus_;
+    if (numa)
+    {
+        //按节点轮流分配 线程只在所在节点的CPU上运行
+        node = index % (int)nodeQues_.size();
+        index /= (int)nodeQues_.size();
+        std::vector<int> nodeCpus = topology.nodeCpus(node);
+        std::vector<int> allowed;
+        for (int cpu : nodeCpus)
+        {
+            if (affinityCpus_.empty()
+                || std::find(affinityCpus_.begin(), affinityCpus_.end(), cpu) != affinityCpus_.end())
+            {
+                allowed.push_back(cpu);
+            }
+        }
+        //指定的CPU集合和这个节点没有交集时 使用节点的所有CPU
+        cpus = allowed.empty() ? nodeCpus : allowed;
+    }
+
+    if (affinity_ == ThreadAffinity::AFFINITY_PER_CORE)
+    {
+        std::vector<int> cores = topology.physicalCores(cpus, node);
+        if (!cores.empty())
+            cpus = { cores[index % cores.size()] };
+    }
+
+    if (!cpus.empty() && !bindCurrentThread(cpus))
+    {
+        POOL_LOG_WARN("bind thread to cpu fail.");
+    }
+    return node < 0 ? 0 : node;
+}
+
+//从优先级队列取一个任务
+bool ThreadPool::popPriorityTask(std::shared_ptr<Task>& task, bool lowBand)
+{
+    if (prioTaskSize_ <= 0)
+        return false;
+    uint64_t now = nowNs();
+    while (prioQue_->pop(task, now, agingNs_, lowBand))
+    {
+        prioTaskSize_--;
+        if (!dropExpired_ || task->deadline_ >= now)
+            return true;
+
+        //已经超过截止时间 不再执行 交给取任务的线程在锁外完成 唤醒等待Result的用户线程
+        //完成时会执行后续回调 回调可能再次提交任务 不能在持有taskQueMtx_时进行
+        POOL_LOG_DEBUG("task deadline expired, dropped.");
+        task->expired_ = true;
+        localStats()->expired_.add();
+        return true;
+    }
+    return false;
+}
+
+//普通线程函数取任务
+bool ThreadPool::popWorkerTask(std::shared_ptr<Task>& task, int node)
+{
+    if (ringQue_ == nullptr)
+    {
+        return popPriorityTask(task, false) || popNodeTask(task, node, false) || popGlobalTask(task)
+            || popNodeTask(task, node, true) || popPriorityTask(task, true);
+    }
+
+    //无锁队列模式 只有优先级队列里有任务时才加锁
+    if (prioTaskSize_ > 0)
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        if (popPriorityTask(task, false))
+            return true;
+    }
+    if (popNodeTask(task, node, false) || popGlobalTask(task) || popNodeTask(task, node, true))
+        return true;
+    if (prioTaskSize_ > 0)
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        return popPriorityTask(task, true);
+    }
+    return false;
+}
+
+//延时提交任务
+Result<> ThreadPool::submitTaskAfter(std::chrono::nanoseconds delay, std::shared_ptr<Task> sp)
+{
+    return submitTaskAt(std::chrono::steady_clock::now() + delay, std::move(sp));
+}
+
+//在time时刻提交任务
+Result<> ThreadPool::submitTaskAt(std::chrono::steady_clock::time_point time, std::shared_ptr<Task> sp)
+{
+    addTimer(time, std::chrono::nanoseconds(0), sp, nullptr);
+    return Result<>(std::move(sp), true);
+}
+
+TimerId ThreadPool::scheduleAfter(std::chrono::nanoseconds delay, std::function<void()> func)
+{
+    return scheduleAt(std::chrono::steady_clock::now() + delay, std::move(func));
+}
+
+TimerId ThreadPool::scheduleAt(std::chrono::steady_clock::time_point time, std::function<void()> func)
+{
+    return addTimer(time, std::chrono::nanoseconds(0), makeFuncTask(std::move(func)), nullptr);
+}
+
+TimerId ThreadPool::scheduleEvery(std::chrono::nanoseconds period, std::function<void()> func)
+{
+    return addTimer(std::chrono::steady_clock::now() + period, period, nullptr,
+        std::make_shared<std::function<void()>>(std::move(func)));
+}
+
+//取消定时器
+bool ThreadPool::cancelTimer(TimerId id)
+{
+    std::lock_guard<std::mutex> guard(timerMtx_);
+    return timerWheel_ != nullptr && timerWheel_->cancel(id);
+}
+
+//添加定时器
+TimerId ThreadPool::addTimer(std::chrono::steady_clock::time_point time, std::chrono::nanoseconds period,
+    std::shared_ptr<Task> task, std::shared_ptr<std::function<void()>> func)
+{
+    std::lock_guard<std::mutex> guard(timerMtx_);
+    if (timerWheel_ == nullptr)
+    {
+        timerWheel_.reset(new TimerWheel(std::chrono::microseconds(TIMER_TICK_US)));
+        timerThread_ = std::thread(&ThreadPool::TimerFunc, this);
+    }
+    uint64_t periodTicks = 0;
+    if (period.count() > 0)
+        periodTicks = std::max<uint64_t>(timerWheel_->ticksOf(period), 1);
+    TimerId id = timerWheel_->add(timerWheel_->tickOf(time), periodTicks, std::move(task), std::move(func));
+
+    //比定时器线程计划醒来的刻度更早 唤醒它重新计算
+    uint64_t next = timerWheel_->nextTick();
+    if (next < timerWakeTick_)
+    {
+        timerWakeTick_ = next;
+        timerCond_.notify_one();
+    }
+    return id;
+}
+
+//定时器线程
+//有定时器时睡到下一个非空槽到期或者需要级联的刻度 没有定时器时一直睡眠 不按刻度空转
+void ThreadPool::TimerFunc()
+{
+    std::vector<TimerWheel::Expired> expired;
+    std::unique_lock<std::mutex> lock(timerMtx_);
+    while (!timerExit_)
+    {
+        timerWheel_->advance(timerWheel_->nowTick(), expired);
+        if (!expired.empty())
+        {
+            //放入任务队列时不持有timerMtx_ 不阻塞添加和取消定时器
+            lock.unlock();
+            fireTimers(expired);
+            expired.clear();
+            lock.lock();
+            continue;
+        }
+
+        timerWakeTick_ = timerWheel_->nextTick();
+        if (timerWakeTick_ == UINT64_MAX)
+            timerCond_.wait(lock);
+        else
+            timerCond_.wait_until(lock, timerWheel_->timeOf(timerWakeTick_));
+    }
+}
+
+//把到期的定时器成批放入任务队列
+void ThreadPool::fireTimers(std::vector<TimerWheel::Expired>& expired)
+{
+    std::vector<std::shared_ptr<Task>> tasks;
+    tasks.reserve(expired.size());
+    for (TimerWheel::Expired& timer : expired)
+    {
+        if (!timer.periodic_)
+        {
+            tasks.push_back(std::move(timer.task_));
+            continue;
+        }
+        //周期任务执行完才安排下一次 不会重叠执行
+        TimerId id = timer.id_;
+        std::shared_ptr<std::function<void()>> func = timer.func_;
+        tasks.push_back(makeFuncTask([this, id, func]() {
+            try
+            {
+                (*func)();
+            }
+            catch (...)
+            {
+                POOL_LOG_ERROR("周期任务抛出异常!");
+            }
+            rearmTimer(id);
+        }));
+    }
+
+    //整批只加一次锁 按任务数量唤醒空闲线程 队列满时不等待
+    size_t accepted = enqueueBatch(tasks.data(), tasks.size(), Admission());
+    if (accepted == tasks.size())
+        return;
+
+    //放不下的一次性任务推迟到下一个刻度 周期任务跳过这一次
+    std::lock_guard<std::mutex> guard(timerMtx_);
+    for (size_t i = accepted; i < tasks.size(); i++)
+    {
+        if (expired[i].periodic_)
+            timerWheel_->rearm(expired[i].id_);
+        else
+            timerWheel_->add(0, 0, std::move(tasks[i]), nullptr);
+    }
+}
+
+//周期定时器执行完一次后安排下一次
+void ThreadPool::rearmTimer(TimerId id)
+{
+    std::lock_guard<std::mutex> guard(timerMtx_);
+    if (timerExit_ || !timerWheel_->rearm(id))
+        return;
+    uint64_t next = timerWheel_->nextTick();
+    if (next < timerWakeTick_)
+    {
+        timerWakeTick_ = next;
+        timerCond_.notify_one();
+    }
+}
+
+//停止定时器线程
+void ThreadPool::stopTimers()
+{
+    {
+        std::lock_guard<std::mutex> guard(timerMtx_);
+        if (timerWheel_ == nullptr)
+            return;
+        timerExit_ = true;
+        timerCond_.notify_all();
+    }
+    timerThread_.join();
+
+    //还没到期的任务不再执行 和被拒绝策略淘汰的任务一样完成 等待Result的线程不会一直阻塞
+    std::vector<std::shared_ptr<Task>> pending;
+    {
+        std::lock_guard<std::mutex> guard(timerMtx_);
+        timerWheel_->clear(pending);
+    }
+    for (std::shared_ptr<Task>& task : pending)
+    {
+        task->dropped_ = true;
+        task->complete();
+    }
+}
+
+//批量提交任务
+BatchResult<> ThreadPool::submitBatch(const std::vector<std::shared_ptr<Task>>& tasks)
+{
+    size_t accepted = enqueueBatch(tasks.data(), tasks.size(), policyAdmission());
+    std::vector<Result<>> results;
+    results.reserve(tasks.size());
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+        results.emplace_back(tasks[i], i < accepted);
+    }
+    return BatchResult<>(std::move(results), accepted);
+}
+
+//批量入队并计数
+size_t ThreadPool::enqueueBatch(const std::shared_ptr<Task>* tasks, size_t count, const Admission& admission)
+{
+    uint64_t now = taskTiming_ ? nowNs() : 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        tasks[i]->enqueueTime_ = now;
+        if (tasks[i]->pool_ != handle_)
+            tasks[i]->pool_ = handle_;
+        tasks[i]->droppable_ = admission.dropOldest_;
+        tasks[i]->runState_.store(Task::RUN_IDLE, std::memory_order_relaxed);
+    }
+    size_t accepted = pushBatch(tasks, count, admission);
+    StatsBlock* stats = localStats();
+    stats->submitted_.add(accepted);
+
+    //整批放不下时 剩下的任务逐个淘汰最早的任务入队 保持被接受的总是前面的任务
+    size_t pushed = accepted;
+    while (admission.dropOldest_ && accepted < count && pushTask(tasks[accepted], admission))
+    {
+        accepted++;
+    }
+    stats->submitted_.add(accepted - pushed);
+    for (size_t i = 0; i < accepted; i++)
+    {
+        tasks[i]->markQueued();
+    }
+    if (accepted > 0)
+        wakeHelpers();
+
+    //剩下的任务由提交任务的线程执行
+    if (admission.callerRuns_)
+    {
+        for (; accepted < count; accepted++)
+        {
+            tasks[accepted]->exec();
+            stats->callerRuns_.add();
+        }
+    }
+    stats->rejected_.add(count - accepted);
+    return accepted;
+}
+
+//把一批任务放入合适的队列
+size_t ThreadPool::pushBatch(const std::shared_ptr<Task>* tasks, size_t count, const Admission& admission)
+{
+    if (count == 0)
+        return 0;
+
+    //工作窃取模式下池内线程整批放入自己的本地队列 放不下整批时走全局队列
+    if (tlsStealPool == this && count <= (size_t)taskQueMaxThreshHold_ && reserveLocal((int)count))
+    {
+        {
+            std::lock_guard<std::mutex> localGuard(tlsLocalQue->mtx_);
+            tlsLocalQue->que_.insert(tlsLocalQue->que_.end(), tasks, tasks + count);
+        }
+        if (sleepThreadSize_ > 0)
+        {
+            std::lock_guard<std::mutex> guard(taskQueMtx_);
+            wakeThreads(count);
+        }
+        return count;
+    }
+
+    //获取锁 整批任务只加一次锁
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    //至少要有一个空位 最多等待admission的时间 淘汰任务逐个进行
+    if (!notFull_.wait_for(lock, admission.timeout_,
+        [&]()->bool { return taskSize_ < taskQueMaxThreshHold_; }))
+    {
+        return 0;
+    }
+
+    //一次预留所有能放下的位置
+    size_t accepted = reserveBatch(count);
+    if (ringQue_ != nullptr)
+    {
+        for (size_t i = 0; i < accepted; i++)
+        {
+            pushRing(std::shared_ptr<Task>(tasks[i]));
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < accepted; i++)
+        {
+            taskQue_.emplace(tasks[i]);
+        }
+        injectTaskSize_ += (int)accepted;
+    }
+
+    //一批任务只唤醒需要的线程数量
+    wakeThreads(accepted);
+
+    //cache模式 任务数量超过空闲线程数量时通知控制线程扩容
+    requestThreads();
+    return accepted;
+}
+
+//唤醒最多count个睡眠的线程
+void ThreadPool::wakeThreads(size_t count)
+{
+    size_t sleepers = std::min(count, (size_t)std::max((int)sleepThreadSize_, 0));
+    for (size_t i = 0; i < sleepers; i++)
+    {
+        notEmpty_.notify_one();
+    }
+}
+
+//cache模式下创建并启动count个新线程
+void ThreadPool::addCachedThreads(int count)
+{
+    //持有锁只登记线程对象和修改计数 真正创建系统线程在锁外进行 不阻塞提交和取任务
+    //线程对象只会被线程自己删除 启动前指针一直有效
+    std::vector<Thread*> created;
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        for (int i = 0; i < count; i++)
+        {
+            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::ThreadFunc, this, std::placeholders::_1));
+            int threadId = ptr->getId();
+            created.push_back(ptr.get());
+            threads_.emplace(threadId, (std::move(ptr)));
+            //修改总线程和空闲线程个数
+            curThreadSize_++;
+            idleThreadSize_++;
+        }
+    }
+    for (Thread* thread : created)
+    {
+        POOL_LOG_INFO(">>>create new thread...", thread->getId());
+        thread->start();
+    }
+    localStats()->threadsCreated_.add(count);
+}
+
+//工作线程进入阻塞区域
+void ThreadPool::beginBlocking()
+{
+    std::unique_lock<std::mutex> lock(compMtx_);
+    blockedThreadSize_++;
+    //还有多出来的补偿线程(阻塞的线程刚返回 它还没停下) 由它代替
+    if (compThreadSize_ >= blockedThreadSize_ || !isPoolRunning_)
+        return;
+
+    //先唤醒备用的补偿线程
+    if (spareThreadSize_ > spareWakeSize_)
+    {
+        spareWakeSize_++;
+        compThreadSize_++;
+        compCond_.notify_one();
+        localStats()->compensated_.add();
+        return;
+    }
+    if (curThreadSize_ >= threadSizeThreshHold_)
+        return;
+    compThreadSize_++;
+    lock.unlock();
+
+    //新建补偿线程 和cache模式新建线程一样登记后在锁外启动
+    Thread* thread;
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::CompensateFunc, this, std::placeholders::_1));
+        thread = ptr.get();
+        threads_.emplace(ptr->getId(), std::move(ptr));
+        curThreadSize_++;
+        idleThreadSize_++;
+    }
+    POOL_LOG_INFO(">>>create compensation thread...", thread->getId());
+    thread->start();
+    StatsBlock* stats = localStats();
+    stats->threadsCreated_.add();
+    stats->compensated_.add();
+}
+
+//工作线程离开阻塞区域 多出来的补偿线程执行完手上的任务后自己停下
+void ThreadPool::endBlocking()
+{
+    std::lock_guard<std::mutex> guard(compMtx_);
+    blockedThreadSize_--;
+}
+
+//补偿线程多于阻塞的线程时转为备用
+bool ThreadPool::parkSpareThread()
+{
+    std::unique_lock<std::mutex> lock(compMtx_);
+    while (compThreadSize_ > blockedThreadSize_)
+    {
+        //备用线程不取任务 不算空闲线程
+        compThreadSize_--;
+        spareThreadSize_++;
+        idleThreadSize_--;
+        compCond_.wait_for(lock, std::chrono::milliseconds(SPARE_THREAD_KEEPALIVE_MS),
+            [&]()->bool { return spareWakeSize_ > 0 || !isPoolRunning_; });
+        spareThreadSize_--;
+        if (spareWakeSize_ == 0)
+            return false; //超时没用上或者线程池要结束
+        //被分配给了一个阻塞的线程 唤醒者已经增加了compThreadSize_
+        spareWakeSize_--;
+        idleThreadSize_++;
+    }
+    return true;
+}
+
+//补偿线程
+//工作窃取模式下用一个不登记的本地队列取任务 提交的任务进入全局队列 退出时不会留下任务
+void ThreadPool::CompensateFunc(int threadid)
+{
+    StatsBlock* stats = localStats();
+    int node = placeCurrentThread();
+    WorkStealQueue localQue;
+    tlsLocalQue = &localQue;
+    tlsWorkerPool = this;
+    tlsWorkerNode = node;
+
+    bool spare = false;
+    for (;;)
+    {
+        if (!parkSpareThread())
+        {
+            spare = true;
+            break;
+        }
+
+        std::shared_ptr<Task> task = popHelpTask(stats);
+        if (task != nullptr)
+        {
+            idleThreadSize_--;
+            runTask(task.get(), stats);
+            idleThreadSize_++;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        if (!isPoolRunning_ && taskSize_ <= 0)
+            break;
+        sleepThreadSize_++;
+        stats->parks_.add();
+        //离开阻塞区域时不唤醒补偿线程 睡眠的补偿线程定时醒来检查自己是不是多余的
+        notEmpty_.wait_for(lock, std::chrono::milliseconds(SPARE_THREAD_KEEPALIVE_MS), [&]()->bool {
+            return taskSize_ > 0 || !isPoolRunning_ || compThreadSize_ > blockedThreadSize_;
+        });
+        sleepThreadSize_--;
+        //成了多余的线程 可能占用了提交任务时的唤醒 转交给其他睡眠的线程
+        if (compThreadSize_ > blockedThreadSize_ && taskSize_ > 0)
+            notEmpty_.notify_one();
+    }
+
+    if (!spare)
+    {
+        std::lock_guard<std::mutex> guard(compMtx_);
+        compThreadSize_--;
+    }
+    tlsLocalQue = nullptr;
+    tlsWorkerPool = nullptr;
+    std::lock_guard<std::mutex> guard(taskQueMtx_);
+    threads_.erase(threadid);
+    curThreadSize_--;
+    if (!spare)
+        idleThreadSize_--;
+    POOL_LOG_INFO("compensation thread exit", threadid);
+    exitCond_.notify_all();
+}
+
+//从全局任务队列取一个任务
+bool ThreadPool::popGlobalTask(std::shared_ptr<Task>& task)
+{
+    if (ringQue_ != nullptr)
+    {
+        return ringQue_->pop(task);
+    }
+    if (taskQue_.empty())
+    {
+        return false;
+    }
+    task = std::move(taskQue_.front());
+    taskQue_.pop();
+    injectTaskSize_--;
+    return true;
+}
+
+//开启线程池
+void ThreadPool::start(int initThreadSize)
+{
+    //设置线程池启动状态
+    isPoolRunning_ = true;
+    //记录初始线程个数
+    initThreadSize_ = initThreadSize;
+    curThreadSize_  = initThreadSize;
+
+    //无锁队列按任务队列上限阈值分配容量
+    if (taskQueMode_ == TaskQueMode::QUE_LOCKFREE)
+    {
+        if (taskQueMaxThreshHold_ > RING_MAX_CAPACITY)
+        {
+            //默认的不限制在头文件里说明 用户设置的阈值被截断时提示
+            if (taskQueMaxThreshHold_ != TASK_MAX_THRESHHOLD)
+                POOL_LOG_WARN("lock-free task queue threshold clamped to", (long long)RING_MAX_CAPACITY);
+            taskQueMaxThreshHold_ = RING_MAX_CAPACITY;
+        }
+        //taskSize_只保证排队的任务不超过上限阈值 取走任务的线程先减计数后释放槽位
+        //容量取阈值的两倍 槽位释放得晚的情况下入队也很少需要等待
+        ringQue_ = std::make_unique<RingQueue<std::shared_ptr<Task>>>((size_t)taskQueMaxThreshHold_ * 2);
+    }
+
+    //开启NUMA感知并且有多个节点时 每个节点一个任务队列
+    if (numaAware_ && CpuTopology::instance().nodeCount() > 1)
+    {
+        for (int node = 0; node < CpuTopology::instance().nodeCount(); node++)
+            nodeQues_.push_back(std::make_unique<WorkStealQueue>());
+    }
+
+    //工作窃取模式使用自己的线程函数
+    auto func = poolMode_ == PoolMode::MODE_STEALING
+        ? &ThreadPool::StealThreadFunc : &ThreadPool::ThreadFunc;
+
+    //创建线程对象 同时把线程函数给到thread对象
+    //考虑线程公平性 先集中创建再启动
+    std::vector<int> threadIds;
+    for (size_t i = 0; i < initThreadSize_; i++)
+    {
+        //创建thread线程对象时，把线程函数给到thread线程对象//注意指针 unique_ptr的使用
+        auto ptr = std::make_unique<Thread>(std::bind(func, this, std::placeholders::_1));//绑定器和函数对象的概念
+        int threadId = ptr->getId();
+        threads_.emplace(threadId, (std::move(ptr))); 
+        threadIds.push_back(threadId);
+
+        //工作窃取模式 线程启动前准备好每个线程的本地队列 之后不再修改 线程间可以无锁地查找
+        if (poolMode_ == PoolMode::MODE_STEALING)
+        {
+            auto que = std::make_unique<WorkStealQueue>();
+            stealQues_.push_back(que.get());
+            localQues_.emplace(threadId, std::move(que));
+        }
+    }
+
+    //启动所有线程
+    //线程id是全局递增的 不一定从0开始 按本次创建的id启动
+    for (int threadId : threadIds)
+    {
+        threads_[threadId]->start();//threads数组里的thread对象 它自己的启动函数
+        //启动线程本身要有执行的线程函数的
+        idleThreadSize_++;//每启动一个线程 记录初始空闲线程数量
+    }
+
+    //cache模式由控制线程负责增减线程
+    if (poolMode_ == PoolMode::MODE_CACHED)
+    {
+        minIdleThreadSize_ = (int)idleThreadSize_;
+        controller_ = std::thread(&ThreadPool::ControllerFunc, this);
+    }
+}
+
+//定义线程函数  线程池的所有任务从队列消费任务
+void ThreadPool::ThreadFunc(int threadid)//线程函数执行完 对应线程即结束
+{
+    StatsBlock* stats = localStats();
+    int node = placeCurrentThread();
+    tlsWorkerPool = this;
+    tlsWorkerNode = node;
+
+    //要所有任务执行完 线程池再回收所有资源
+    for (;;)//回收
+    {
+        std::shared_ptr<Task> task;
+        {
+            //获取锁 无锁队列模式下取任务不需要锁 只在需要睡眠时才加锁
+            std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+            if (ringQue_ == nullptr)
+                lock.lock();
+            POOL_LOG_DEBUG("尝试获取任务!");
+
+            //cache模式下多余的空闲线程由控制线程决定回收 空闲线程只在有任务或者被要求退出时唤醒
+            //锁 ＋ 双重判断
+            bool spun = false;
+            while (!popWorkerTask(task, node))
+            {
+                //睡眠前先自旋等待一会儿 突发的短任务不用经过futex睡眠和唤醒
+                if (!spun && spinCount_ > 0)
+                {
+                    spun = true;
+                    if (lock.owns_lock())
+                        lock.unlock();
+                    bool hasTask = spinWait();
+                    if (ringQue_ == nullptr)
+                        lock.lock();
+                    if (hasTask)
+                        continue;
+                }
+
+                if (!lock.owns_lock())
+                    lock.lock();
+                //线程池要结束，回收线程资源
+                if (!isPoolRunning_ && taskSize_ <= 0)
+                {
+                    threads_.erase(threadid);
+                    tlsWorkerPool = nullptr;
+                    POOL_LOG_INFO("thread exit", threadid);
+                    exitCond_.notify_all();
+                    return;
+                }
+
+                //先登记睡眠再检查任务数量 与无锁队列的提交方先加任务数量再检查睡眠线程数量相对应
+                sleepThreadSize_++;
+                stats->parks_.add();
+                auto hasTask = [&]()->bool { return taskSize_ > 0 || !isPoolRunning_; };
+                if (poolMode_ == PoolMode::MODE_CACHED)
+                {
+                    //没有超时 不再每秒醒来检查空闲时间
+                    notEmpty_.wait(lock, [&]()->bool { return hasTask() || retireThreadSize_ > 0; });
+
+                    //认领一个回收名额 线程池析构时不再认领 回到循环开头按退出流程返回
+                    int retire = isPoolRunning_ ? (int)retireThreadSize_ : 0;
+                    while (retire > 0 && !retireThreadSize_.compare_exchange_weak(retire, retire - 1))
+                        ;
+                    if (retire > 0)
+                    {
+                        //回收当前线程
+                        //通过threadid 去把thread对象删除
+                        sleepThreadSize_--;
+                        threads_.erase(threadid);
+                        tlsWorkerPool = nullptr;
+                        curThreadSize_--;
+                        idleThreadSize_--;
+                        stats->threadsReaped_.add();
+                        //可能占用了提交任务时的唤醒 转交给其他睡眠的线程
+                        if (taskSize_ > 0)
+                            notEmpty_.notify_one();
+                        //和退出流程一样通知 析构函数可能在等最后一个线程
+                        exitCond_.notify_all();
+
+                        POOL_LOG_INFO("idle thread exit", threadid);
+                        return;
+                    }
+                }
+                else
+                {
+                    //等待notempty条件
+                    notEmpty_.wait(lock, hasTask);
+                }
+                sleepThreadSize_--;
+
+                //无锁队列取任务不需要持有锁
+                if (ringQue_ != nullptr)
+                    lock.unlock();
+            }
+
+            int idle = --idleThreadSize_;
+            //记录保活周期内空闲线程数量的最小值 控制线程据此判断有多少线程是多余的
+            if (poolMode_ == PoolMode::MODE_CACHED && idle < minIdleThreadSize_)
+                minIdleThreadSize_ = idle;
+
+            POOL_LOG_DEBUG("获取任务成功!");
+            taskTaken(lock);
+        }//自动把锁释放
+
+        if (task != nullptr) 
+        {
+            POOL_LOG_DEBUG("开始执行任务!");
+            //当前线程负责执行这个任务
+            //执行任务 返回值存放在task里 Result可以取了
+            runTask(task.get(), stats);
+        }
+        else {
+            POOL_LOG_ERROR("执行任务失败!");
+        }
+        idleThreadSize_++;//此线程已将任务执行完 该线程成为空闲线程
+    }
+}
+
+//cache模式的控制线程
+//扩容：任务数量超过空闲线程数量 并且按最近吞吐量估算的排队时间(排队任务数/每秒完成数)超过目标时
+//     补足差额 每次最多翻倍 完成速度足够快的短暂积压不扩容
+//缩容：一个保活周期内空闲线程数量的最小值就是整个周期都没用上的线程 周期结束时回收这么多
+//     刚扩容过的周期不回收 扩容和缩容之间有一个保活周期的滞后 避免突发流量下反复创建销毁
+//有任务排队时按固定间隔采样 空闲时只在保活周期结束或者提交方请求扩容时醒来
+void ThreadPool::ControllerFunc()
+{
+    using Clock = std::chrono::steady_clock;
+    auto lastTick = Clock::now();
+    auto windowStart = lastTick;
+    uint64_t lastCompleted = completedCount();
+    double rate = 0;        //所有线程都忙时每秒完成的任务数量 指数平均
+    bool saturated = false; //上次采样时有任务在排队 这段时间的完成速度代表线程池的处理能力
+    int threshhold = threadSizeThreshHold_;
+    int minThreads = minThreadSize_ < 0 ? (int)initThreadSize_ : minThreadSize_;
+    if (minThreads > threshhold)
+        minThreads = threshhold;
+
+    std::unique_lock<std::mutex> lock(ctrlMtx_);
+    while (isPoolRunning_)
+    {
+        auto signaled = [&]()->bool { return ctrlSignaled_ || !isPoolRunning_; };
+        if (taskSize_ > 0 || saturated || curThreadSize_ < minThreads)
+            ctrlCond_.wait_for(lock, std::chrono::milliseconds(CONTROL_INTERVAL_MS), signaled);
+        else if (curThreadSize_ > minThreads)
+            ctrlCond_.wait_until(lock, windowStart + keepAlive_, signaled);
+        else
+            ctrlCond_.wait(lock, signaled);
+        ctrlSignaled_ = false;
+        if (!isPoolRunning_)
+            break;
+        lock.unlock();
+
+        auto now = Clock::now();
+        uint64_t completed = completedCount();
+        double elapsed = std::chrono::duration<double>(now - lastTick).count();
+        if (saturated && elapsed > 0)
+        {
+            double measured = (double)(completed - lastCompleted) / elapsed;
+            rate = rate > 0 ? (rate + measured) / 2 : measured;
+        }
+        lastTick = now;
+        lastCompleted = completed;
+
+        int backlog = taskSize_;
+        int idle = idleThreadSize_;
+        int cur = curThreadSize_;
+        saturated = backlog > 0;
+
+        int grow = 0;
+        if (cur < minThreads)
+        {
+            grow = minThreads - cur;
+        }
+        else if (backlog > idle && cur < threshhold)
+        {
+            //还没测到处理能力时按排队时间无限大处理
+            double waitUs = rate > 0 ? backlog / rate * 1e6 : 1e18;
+            if (waitUs > (double)targetWait_.count())
+                grow = std::min(backlog - idle, std::max(cur, 1));
+        }
+        grow = std::min(grow, threshhold - cur);
+        if (grow > 0)
+        {
+            addCachedThreads(grow);
+            windowStart = now;
+            minIdleThreadSize_ = (int)idleThreadSize_;
+        }
+        else if (now - windowStart >= keepAlive_)
+        {
+            //只回收正在睡眠的线程 唤醒的线程认领回收名额后退出
+            int retire = std::min((int)minIdleThreadSize_, (int)idleThreadSize_);
+            retire = std::min(retire, cur - minThreads);
+            std::lock_guard<std::mutex> guard(taskQueMtx_);
+            retire = std::min(retire, (int)sleepThreadSize_);
+            if (retire > 0)
+            {
+                POOL_LOG_INFO("retire idle threads", retire);
+                retireThreadSize_ = retire;
+                wakeThreads(retire);
+            }
+            windowStart = now;
+            minIdleThreadSize_ = (int)idleThreadSize_;
+        }
+        lock.lock();
+    }
+}
+
+//cache模式下通知控制线程扩容
+void ThreadPool::requestThreads()
+{
+    if (poolMode_ == PoolMode::MODE_CACHED
+        && taskSize_ > idleThreadSize_
+        && curThreadSize_ < threadSizeThreshHold_
+        && !ctrlSignaled_
+        && !ctrlSignaled_.exchange(true))
+    {
+        std::lock_guard<std::mutex> guard(ctrlMtx_);
+        ctrlCond_.notify_one();
+    }
+}
+
+//所有线程完成的任务总数
+uint64_t ThreadPool::completedCount() const
+{
+    uint64_t total = 0;
+    std::lock_guard<std::mutex> guard(statsMtx_);
+    for (const auto& block : statsBlocks_)
+    {
+        total += block->completed_.get();
+    }
+    return total;
 }
 
-//设置线程池工作模式
-void ThreadPool::setMode(PoolMode mode)
+//工作窃取模式的线程函数
+void ThreadPool::StealThreadFunc(int threadid)
 {
-    if (checkRunningState())
-        return;
-    poolMode_ = mode;
+    WorkStealQueue* localQue = localQues_.find(threadid)->second.get();
+    tlsStealPool = this;
+    tlsLocalQue = localQue;
+    StatsBlock* stats = localStats();
+    int node = placeCurrentThread();
+    tlsWorkerPool = this;
+    tlsWorkerNode = node;
+
+    for (;;)
+    {
+        std::shared_ptr<Task> task = findStealTask(localQue, stats, node);
+        if (task != nullptr)
+        {
+            idleThreadSize_--;
+            runTask(task.get(), stats);
+            idleThreadSize_++;
+            continue;
+        }
+
+        //所有队列都没有任务 先自旋等待一会儿 再睡眠等待
+        if (spinCount_ > 0 && spinWait() && isPoolRunning_)
+            continue;
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        //线程池要结束 且任务都执行完了 回收线程
+        if (!isPoolRunning_ && taskSize_ <= 0)
+        {
+            threads_.erase(threadid);
+            tlsStealPool = nullptr;
+            tlsLocalQue = nullptr;
+            tlsWorkerPool = nullptr;
+            POOL_LOG_INFO("thread exit", threadid);
+            exitCond_.notify_all();
+            return;
+        }
+        //先登记睡眠再检查任务数量 与提交方先加任务数量再检查睡眠线程数量相对应
+        sleepThreadSize_++;
+        stats->parks_.add();
+        notEmpty_.wait(lock, [&]()->bool { return taskSize_ > 0 || !isPoolRunning_; });
+        sleepThreadSize_--;
+    }
 }
 
-/*设置初始线程数量
-void ThreadPool::setInitThreadSize(int size)
+//工作窃取模式下取任务
+std::shared_ptr<Task> ThreadPool::findStealTask(WorkStealQueue* localQue, StatsBlock* stats, int node)
 {
-    initThreadSize_ = size;
+    std::shared_ptr<Task> task;
+
+    //0.优先级队列里的高优先级、普通优先级和老化的低优先级任务
+    if (prioTaskSize_ > 0)
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        popPriorityTask(task, false);
+    }
+
+    //1.本地队列 从队尾取最近放入的任务
+    if (task == nullptr)
+    {
+        std::lock_guard<std::mutex> guard(localQue->mtx_);
+        if (!localQue->que_.empty())
+        {
+            task = std::move(localQue->que_.back());
+            localQue->que_.pop_back();
+        }
+    }
+
+    //本节点队列 带节点提示提交的任务
+    if (task == nullptr)
+    {
+        popNodeTask(task, node, false);
+    }
+
+    //2.全局注入队列 外部线程提交的任务 无锁队列模式下直接取
+    if (task == nullptr && ringQue_ != nullptr)
+    {
+        popGlobalTask(task);
+    }
+    else if (task == nullptr && injectTaskSize_ > 0)
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        popGlobalTask(task);
+    }
+
+    //3.从其他线程的队头窃取 从随机位置开始遍历 避免所有窃取者都盯着同一个队列
+    if (task == nullptr)
+    {
+        thread_local unsigned int seed = std::hash<std::thread::id>()(std::this_thread::get_id());
+        seed = seed * 1103515245 + 12345;
+        size_t queSize = stealQues_.size();
+        size_t start = (seed >> 16) % queSize;
+        for (size_t i = 0; i < queSize && task == nullptr; i++)
+        {
+            WorkStealQueue* victim = stealQues_[(start + i) % queSize];
+            if (victim == localQue)
+                continue;
+            std::lock_guard<std::mutex> guard(victim->mtx_);
+            if (!victim->que_.empty())
+            {
+                task = std::move(victim->que_.front());
+                victim->que_.pop_front();
+                stats->steals_.add();
+            }
+        }
+    }
+
+    //其他节点队列 那些节点的线程都在忙
+    if (task == nullptr)
+    {
+        popNodeTask(task, node, true);
+    }
+
+    //4.所有普通任务都没有了 才取低优先级任务
+    if (task == nullptr && prioTaskSize_ > 0)
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        popPriorityTask(task, true);
+    }
+
+    //取出任务需要通知,可以继续生产任务 只有队列满过才会有提交者在等待
+    if (task != nullptr && taskSize_-- >= taskQueMaxThreshHold_)
+    {
+        std::lock_guard<std::mutex> guard(taskQueMtx_);
+        notFull_.notify_all();
+    }
+    return task;
 }
-*/
 
-//设置task任务队列上限阈值
-void ThreadPool::settaskQueMaxThreshHold(int threshhold)
+//执行一个从队列取出的任务
+bool ThreadPool::runTask(Task* task, StatsBlock* stats)
 {
-    if (checkRunningState())
-        return;
-    taskQueMaxThreshHold_ = threshhold;
+    //等待它的工作线程已经直接执行了 队列里的这一份只是占位
+    if (task->runState_.exchange(Task::RUN_STARTED) == Task::RUN_STARTED)
+        return false;
+    execTask(task, stats);
+    return true;
 }
-//设置线程数量上限阈值
-void ThreadPool::setthreadSizeThreshHold(int threshhold)
+
+//执行任务
+void ThreadPool::execTask(Task* task, StatsBlock* stats)
 {
-    if (checkRunningState())
+    //超过截止时间被丢弃的任务只通知完成 不执行
+    if (task->expired_)
+    {
+        task->complete();
         return;
-    threadSizeThreshHold_ = threshhold;
+    }
+    if (task->enqueueTime_ != 0)
+    {
+        uint64_t startTime = nowNs();
+        stats->queueWait_.record(startTime - task->enqueueTime_);
+        task->exec();
+        stats->runTime_.record(nowNs() - startTime);
+    }
+    else
+    {
+        task->exec();
+    }
+    stats->completed_.add();
 }
 
-//给线程池提交任务   用户调用该接口，传入任务对象，生产任务
-Result ThreadPool::submitTask(std::shared_ptr<Task> sp)//让用户直接传智能指针进来，规避生命周期太短的任务。
+//工作线程取出一个任务后更新排队数量
+void ThreadPool::taskTaken(std::unique_lock<std::mutex>& lock)
 {
-    //获取锁
-    std::unique_lock<std::mutex> lock(taskQueMtx_);
-
-    //线程通信--等待任务队列有空余节点
-    /*基本实现
-    while (taskQue_.size() == taskQueMaxThreshHold_)
+    //每个任务入队时已经唤醒了一个线程 取出任务后不再通知其他线程
+    int prevTaskSize = taskSize_--;
+    if (ringQue_ == nullptr)
     {
-        notFull_.wait(lock);//改变线程状态
+        //取出任务需要通知,可以继续生产任务
+        notFull_.notify_all();
     }
-    */
-    /*使用封装做*/ //设置wait的超时时间 否则阻塞用户进程太久
-    if (!notFull_.wait_for(lock, std::chrono::seconds(1),
-        [&]()->bool { return taskQue_.size() < (size_t)taskQueMaxThreshHold_; }))//通过正则表达式来判断  注意重载的wait的用法
+    else if (prevTaskSize >= taskQueMaxThreshHold_)
     {
-        //返回false ：等待一秒钟但仍不能满足notfull条件
-        std::cerr << "task queue is full, task submit fail." << std::endl;
-        return Result(sp, false);//线程执行完后pop，task对象就被析构了，不可用task->getResult();
+        //无锁队列只有满过才会有提交者在等待
+        lock.lock();
+        notFull_.notify_all();
+        lock.unlock();
     }
-    //若有空余，任务放入任务队列
-    taskQue_.emplace(sp);
-    taskSize_++;
-
-    //放入任务后，线程队列至少有一个线程，必定通知 notEmpty，分配线程执行任务
-    notEmpty_.notify_all();
+}
 
-    //cache模式 根据任务数量和空闲线程数量，判断是否创建新线程
-    //cache模式 任务处理紧急 场景：小而快的任务
-    if (poolMode_ == PoolMode::MODE_CACHED
-        && taskSize_ > idleThreadSize_
-        && curThreadSize_ < threadSizeThreshHold_)
+//工作线程等待时取一个任务
+std::shared_ptr<Task> ThreadPool::popHelpTask(StatsBlock* stats)
+{
+    if (poolMode_ == PoolMode::MODE_STEALING)
     {
-        std::cout << ">>>create new thread..." << std::endl;
-        //创建新线程对象
-        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::ThreadFunc, this, std::placeholders::_1));
-        //threads_.emplace_back(std::move(ptr));
-        int threadId = ptr->getId();
-        threads_.emplace(threadId, (std::move(ptr)));
-        //启动线程
-        threads_[threadId]->start();
-        //修改总线程和空闲线程个数
-        curThreadSize_++;
-        idleThreadSize_++;
+        //先取自己本地队列队尾的任务 通常就是刚拆出去、现在正在等待的子任务
+        return findStealTask(tlsLocalQue, stats, tlsWorkerNode);
     }
 
-    //返回任务的result对象
-    return Result(sp);
+    std::shared_ptr<Task> task;
+    std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+    if (ringQue_ == nullptr)
+        lock.lock();
+    if (popWorkerTask(task, tlsWorkerNode))
+        taskTaken(lock);
+    return task;
 }
 
-//开启线程池
-void ThreadPool::start(int initThreadSize)
+//工作线程等待done时执行排队的任务
+//正在执行的任务仍然占着当前线程 空闲线程数量不变
+//被执行的任务在等待者的栈上运行 递归很深的分治会相应地加深线程栈
+void ThreadPool::helpUntil(Completion& done, Task* awaited)
 {
-    //设置线程池启动状态
-    isPoolRunning_ = true;
-    //记录初始线程个数
-    initThreadSize_ = initThreadSize;
-    curThreadSize_  = initThreadSize;
+    StatsBlock* stats = localStats();
 
-    //创建线程对象 同时把线程函数给到thread对象
-    //考虑线程公平性 先集中创建再启动
-    for (int i = 0; i < initThreadSize_; i++)
+    //被等待的任务还在队列里 直接执行 省去排队 队列里的那一份取出后跳过
+    //有截止时间的任务留在队列里 由取任务的线程按截止时间处理
+    if (awaited != nullptr && awaited->deadline_ == UINT64_MAX && awaited->claim())
     {
-        //创建thread线程对象时，把线程函数给到thread线程对象//注意指针 unique_ptr的使用
-        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::ThreadFunc, this, std::placeholders::_1));//绑定器和函数对象的概念
-        int threadId = ptr->getId();
-        threads_.emplace(threadId, (std::move(ptr))); 
+        execTask(awaited, stats);
+        stats->helped_.add();
     }
 
-    //启动所有线程
-    for (int i = 0; i < initThreadSize_; i++)
+    while (!done.ready())
     {
-        threads_[i]->start();//threads数组里的thread对象 它自己的启动函数
-        //启动线程本身要有执行的线程函数的
-        idleThreadSize_++;//每启动一个线程 记录初始空闲线程数量
+        std::shared_ptr<Task> task = popHelpTask(stats);
+        if (task != nullptr)
+        {
+            if (runTask(task.get(), stats))
+                stats->helped_.add();
+            continue;
+        }
+        //没有排队的任务 被等待的任务正在其他线程上执行 睡眠到它完成或者有新任务入队
+        //先登记再检查任务数量 与提交方先加任务数量再检查helpWaiterSize_相对应 两边都是顺序一致的原子操作
+        {
+            std::lock_guard<std::mutex> guard(helpMtx_);
+            helpWaiters_.push_back(&done);
+        }
+        helpWaiterSize_++;
+        if (done.arm() && taskSize_ <= 0)
+            done.sleepOnce();
+        helpWaiterSize_--;
+        {
+            std::lock_guard<std::mutex> guard(helpMtx_);
+            helpWaiters_.erase(std::find(helpWaiters_.begin(), helpWaiters_.end(), &done));
+        }
     }
 }
 
-//定义线程函数  线程池的所有任务从队列消费任务
-void ThreadPool::ThreadFunc(int threadid)//线程函数执行完 对应线程即结束
+//叫醒所有在helpUntil里睡眠的工作线程 只有它们知道自己能执行哪些队列里的任务
+void ThreadPool::wakeHelpers()
 {
-    auto lastTime = std::chrono::high_resolution_clock().now();
+    if (helpWaiterSize_ <= 0)
+        return;
+    std::lock_guard<std::mutex> guard(helpMtx_);
+    for (Completion* done : helpWaiters_)
+        done->interrupt();
+}
 
-    //要所有任务执行完 线程池再回收所有资源
-    for (;;)//回收
+BlockingScope::BlockingScope()
+    : pool_(tlsWorkerPool)
+{
+    if (pool_ != nullptr && tlsBlockingDepth++ == 0)
+        pool_->beginBlocking();
+}
+
+BlockingScope::~BlockingScope()
+{
+    if (pool_ != nullptr && --tlsBlockingDepth == 0)
+        pool_->endBlocking();
+}
+
+//等待完成 工作线程等待时执行排队的任务
+void helpWait(Completion& done, Task* awaited)
+{
+    if (done.ready())
+        return;
+    ThreadPool* pool = tlsWorkerPool;
+    if (pool == nullptr)
     {
-        std::shared_ptr<Task> task;
-        {
-            //获取锁
-            std::unique_lock<std::mutex> lock(taskQueMtx_);
-            std::cout << "tid:" << std::this_thread::get_id()
-                << "尝试获取任务!" << std::endl;
+        done.wait();
+        return;
+    }
+    pool->helpUntil(done, awaited);
+}
 
-            //cache模式下有可能已经创建很多线程但是没有任务去使用 空闲时间超过某个时间
-            //需要回收线程 超过initThreadSize 的要回收
-            //记录当前时间，记录上一次线程执行时间 》 60s
+//当前线程在这个线程池的统计计数
+StatsBlock* ThreadPool::localStats() const
+{
+    for (const LocalStats& local : tlsStats)
+    {
+        if (local.poolId_ == poolId_)
+            return local.block_;
+    }
 
-            //每秒返回一次：：判断是超时返回还是有任务待执行返回
-            //锁 ＋ 双重判断
-            while (taskQue_.size() == 0)
-            {
-                if (!isPoolRunning_)
-                {
-                    threads_.erase(threadid);
-                    std::cout << "threadid" << std::this_thread::get_id() << "exit"
-                        << std::endl;
-                    exitCond_.notify_all();
-                    return;
-                }
-                if (poolMode_ == PoolMode::MODE_CACHED)
-                {
-                    if (std::cv_status::timeout ==
-                        notEmpty_.wait_for(lock, std::chrono::seconds(1)))
-                    {
-                        //条件变量超时返回
-                        auto nowTime = std::chrono::high_resolution_clock().now();
-                        auto dur = std::chrono::duration_cast<std::chrono::seconds>(nowTime - lastTime);
-                        if (dur.count() >= THREAD_MAX_IDLE_TIME
-                            && curThreadSize_ > initThreadSize_)
-                        {
-                            //回收当前线程
-                            //记录线程数量的相关变量值的修改，匹配线程的变化
-                            //把线程对象从线程vector删除 如何匹配thread_func 和thread对象//需要映射关系
-                            //通过threadid 去把thread对象删除
-                            threads_.erase(threadid);
-                            curThreadSize_--;
-                            idleThreadSize_--;
-
-                            std::cout << "threadid" << std::this_thread::get_id() << "exit"
-                                << std::endl;
-                            return;
-                        }
-                    }
-                }
-                else
-                {
-                    //等待notempty条件
-                    notEmpty_.wait(lock);
-                }
-                /*
-                //线程池要结束，回收线程资源
-                if (!isPoolRunning_)
-                {
-                    threads_.erase(threadid);
-                    std::cout << "threadid" << std::this_thread::get_id() << "exit"
-                        << std::endl;
-                    exitCond_.notify_all();
-                    return;
-                }
-                */
-            }
-            
-            // 线程池结束了
-            //if (!isPoolRunning_)
-            //{
-              //  break;
-            //}
-            
-            idleThreadSize_--;
+    //第一次在这个线程池里计数 创建并登记 线程池析构时统一释放
+    auto block = std::make_unique<StatsBlock>();
+    StatsBlock* ptr = block.get();
+    {
+        std::lock_guard<std::mutex> guard(statsMtx_);
+        statsBlocks_.push_back(std::move(block));
+    }
+    if (tlsStats.size() >= LOCAL_STATS_CACHE_SIZE)
+        tlsStats.erase(tlsStats.begin());
+    tlsStats.push_back(LocalStats{ poolId_, ptr });
+    return ptr;
+}
 
-            std::cout << "tid:" << std::this_thread::get_id()
-                << "获取任务成功!" << std::endl;
+//获取线程池的统计快照
+PoolStats ThreadPool::stats() const
+{
+    PoolStats result;
+    result.curThreadSize = curThreadSize_;
+    result.idleThreadSize = idleThreadSize_;
+    result.taskSize = std::max((int)taskSize_, 0);
 
-            //从任务队列取一个任务//取出
-            task = taskQue_.front();
-            taskQue_.pop();
-            taskSize_--;
+    std::lock_guard<std::mutex> guard(statsMtx_);
+    for (const auto& block : statsBlocks_)
+    {
+        result.submitted += block->submitted_.get();
+        result.rejected += block->rejected_.get();
+        result.callerRuns += block->callerRuns_.get();
+        result.dropped += block->dropped_.get();
+        result.expired += block->expired_.get();
+        result.completed += block->completed_.get();
+        result.threadsCreated += block->threadsCreated_.get();
+        result.threadsReaped += block->threadsReaped_.get();
+        result.steals += block->steals_.get();
+        result.parks += block->parks_.get();
+        result.helped += block->helped_.get();
+        result.compensated += block->compensated_.get();
+        block->queueWait_.mergeTo(result.queueWait);
+        block->runTime_.mergeTo(result.runTime);
+    }
+    return result;
+}
 
-            // 若有队列任务剩余，则继续通知其他线程
-            // 功能函数写完不要忘记条件变量的相应通知
-            if (taskQue_.size() > 0)
-            {
-                notEmpty_.notify_all();
-            }
+//开启或关闭任务计时 运行中也可以切换
+void ThreadPool::setTaskTiming(bool enable)
+{
+    taskTiming_ = enable;
+}
 
-            //取出任务需要通知,可以继续生产任务
-            notFull_.notify_all();
-        }//自动把锁释放
+//是否有空闲线程可以马上执行新任务
+bool ThreadPool::hasIdleThread() const
+{
+    return idleThreadSize_ > taskSize_;
+}
 
-        if (task != nullptr) 
-        {
-            std::cout << "tid:" << std::this_thread::get_id()
-                << "执行任务成功!" << std::endl;
-            //当前线程负责执行这个任务
-            //task->run();执行任务并把任务返回值通过setVal给到Result
-            task->exec();
-        }
-        else {
-            std::cout << "tid:" << std::this_thread::get_id()
-                << "执行任务失败!" << std::endl;
-        }
-        idleThreadSize_++;//此线程已将任务执行完 该线程成为空闲线程
-        lastTime = std::chrono::high_resolution_clock().now(); // 更新线程执行完时间戳
+//空闲线程自旋等待新任务 有任务或者线程池要结束时返回true
+bool ThreadPool::spinWait()
+{
+    for (int i = 0; i < spinCount_; i++)
+    {
+        if (taskSize_ > 0 || !isPoolRunning_)
+            return true;
+        cpuRelax();
+        //自旋一段时间后让出CPU 给同一核上的其他线程运行的机会
+        if ((i & 63) == 63)
+            std::this_thread::yield();
     }
+    return false;
 }
 
 bool ThreadPool::checkRunningState() const
@@ -292,44 +2037,235 @@ int Thread::getId()const
 }
 
 ////////////////////////////////////task方法实现
+Task::Continuation Task::closedList;
+
 Task::Task()
-    : result_(nullptr)
+    : execFunc_(&Task::execRun)
 {}
 
-void Task::exec()
+Task::Task(ExecFunc func)
+    : execFunc_(func)
+{}
+
+//任务没有执行(例如提交失败)时 释放登记了但没有执行的回调
+Task::~Task()
 {
-    if (result_ != nullptr) 
+    Continuation* node = continuations_.load(std::memory_order_acquire);
+    while (node != nullptr && node != &closedList)
     {
-        result_->setVal(run());//发生多态调用
+        Continuation* next = node->next_;
+        delete node;
+        node = next;
     }
 }
 
-void Task::setResult(Result* res)
+void Task::exec()
+{
+    execFunc_(this);
+}
+
+void Task::execRun(Task* task)
 {
-    result_ = res;
+    task->value_ = task->run();//发生多态调用
+    task->complete(); //通知Result 返回值已经可以取了
 }
 
-////////////////////////////////////Result 方法的实现
-Result::Result(std::shared_ptr<Task> task, bool isValid)
-    :isValid_(isValid)
-    ,task_(task)
+void Task::complete()
 {
-    task_->setResult(this);
+    done_.set();
+
+    //取走所有回调 之后登记的回调直接执行
+    Continuation* node = continuations_.exchange(&closedList, std::memory_order_acq_rel);
+    //链表头是最后登记的 反转后按登记顺序执行
+    Continuation* ordered = nullptr;
+    while (node != nullptr)
+    {
+        Continuation* next = node->next_;
+        node->next_ = ordered;
+        ordered = node;
+        node = next;
+    }
+    while (ordered != nullptr)
+    {
+        Continuation* next = ordered->next_;
+        ordered->func_();
+        delete ordered;
+        ordered = next;
+    }
+}
+
+void Task::addContinuation(std::function<void()> func)
+{
+    Continuation* node = new Continuation{ std::move(func), continuations_.load(std::memory_order_acquire) };
+    while (node->next_ != &closedList)
+    {
+        if (continuations_.compare_exchange_weak(node->next_, node,
+            std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            return;
+        }
+    }
+    //任务已经完成
+    std::function<void()> call = std::move(node->func_);
+    delete node;
+    call();
 }
 
-Any Result::get()
+////////////////////////////////////Result 方法的实现
+Result<Any>::Result(std::shared_ptr<Task> task, bool isValid)
+    :task_(std::move(task))
+    ,isValid_(isValid)
+{}
+
+Any Result<Any>::get()
 {
     if (!isValid_)
     {
         return "";
     }
-    sema_.wait();//等待task执行完，阻塞用户线程
-    return std::move(any_);
+    helpWait(task_->done_, task_.get());//等待task执行完，阻塞用户线程 工作线程上等待时执行其他任务
+    if (task_->expired_ || task_->dropped_)
+    {
+        //超过截止时间或者被拒绝策略丢弃 和提交失败一样返回空值
+        return "";
+    }
+    return std::move(task_->value_);
+}
+
+void Result<Any>::wait()
+{
+    if (isValid_)
+        helpWait(task_->done_, task_.get());
+}
+
+bool Result<Any>::ready() const
+{
+    return isValid_ && task_->done_.ready();
+}
+
+bool Result<Any>::valid() const
+{
+    return isValid_ && !task_->expired_ && !task_->dropped_;
+}
+
+////////////////////////////////////Completion 方法的实现
+#ifdef __linux__
+//Linux下直接用futex 在state_这个32位整数上睡眠和唤醒 不需要额外的互斥锁和条件变量
+bool Completion::waitFor(long long timeoutNs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(timeoutNs);
+    for (;;)
+    {
+        //登记有等待者 set时看到STATE_WAITING才会发起唤醒
+        uint32_t expected = STATE_PENDING;
+        if (!state_.compare_exchange_strong(expected, STATE_WAITING, std::memory_order_acquire)
+            && expected == STATE_DONE)
+        {
+            return true;
+        }
+
+        struct timespec ts;
+        struct timespec* pts = nullptr;
+        if (timeoutNs >= 0)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0)
+                return ready();
+            ts.tv_sec = left / 1000000000;
+            ts.tv_nsec = left % 1000000000;
+            pts = &ts;
+        }
+        //state_仍然是STATE_WAITING才睡眠 否则立即返回重新检查
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state_), FUTEX_WAIT_PRIVATE,
+            STATE_WAITING, pts, nullptr, 0);
+        if (ready())
+            return true;
+    }
+}
+
+void Completion::wakeAll()
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state_), FUTEX_WAKE_PRIVATE,
+        INT32_MAX, nullptr, nullptr, 0);
+}
+
+void Completion::sleepOnce()
+{
+    //interrupt已经撤销了登记时state_不是STATE_WAITING 立即返回
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state_), FUTEX_WAIT_PRIVATE,
+        STATE_WAITING, nullptr, nullptr, 0);
+}
+#else
+//其他平台没有futex 按地址分散到一组互斥锁和条件变量上 Completion本身不增加大小
+//set看到STATE_WAITING时加锁再通知 等待者持有同一把锁检查状态后才睡眠 不会漏掉唤醒
+const size_t COMPLETION_PARK_SLOTS = 64;
+
+struct CompletionPark
+{
+    std::mutex mtx_;
+    std::condition_variable cond_;
+};
+
+//故意不析构 进程退出时分离的线程可能还在等待
+static CompletionPark& parkOf(const void* addr)
+{
+    static CompletionPark* slots = new CompletionPark[COMPLETION_PARK_SLOTS];
+    return slots[(reinterpret_cast<uintptr_t>(addr) >> 6) % COMPLETION_PARK_SLOTS];
+}
+
+bool Completion::waitFor(long long timeoutNs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(timeoutNs);
+    CompletionPark& park = parkOf(this);
+    std::unique_lock<std::mutex> lock(park.mtx_);
+    for (;;)
+    {
+        //登记有等待者 set时看到STATE_WAITING才会加锁通知
+        uint32_t expected = STATE_PENDING;
+        if (!state_.compare_exchange_strong(expected, STATE_WAITING, std::memory_order_acquire)
+            && expected == STATE_DONE)
+        {
+            return true;
+        }
+        //同一个槽位上其他Completion的通知也会唤醒这里 醒来后重新检查
+        if (timeoutNs < 0)
+            park.cond_.wait(lock);
+        else if (park.cond_.wait_until(lock, deadline) == std::cv_status::timeout)
+            return ready();
+        if (ready())
+            return true;
+    }
+}
+
+//只用到地址 等待者醒来后可能已经释放了这个对象
+void Completion::wakeAll()
+{
+    CompletionPark& park = parkOf(this);
+    std::lock_guard<std::mutex> guard(park.mtx_);
+    park.cond_.notify_all();
+}
+
+void Completion::sleepOnce()
+{
+    //interrupt已经撤销了登记时state_不是STATE_WAITING 立即返回
+    CompletionPark& park = parkOf(this);
+    std::unique_lock<std::mutex> lock(park.mtx_);
+    if (state_.load() == STATE_WAITING)
+        park.cond_.wait(lock);
+}
+#endif
+
+bool Completion::arm()
+{
+    uint32_t expected = STATE_PENDING;
+    return state_.compare_exchange_strong(expected, STATE_WAITING) || expected == STATE_WAITING;
 }
 
-void Result::setVal(Any any)
+//撤销登记并唤醒所有等待者 普通的等待者醒来后看到没有完成会重新登记
+void Completion::interrupt()
 {
-    //存储task返回值
-    this->any_ = std::move(any);
-    sema_.post(); //已经获取的任务返回值，增加信号量资源
+    uint32_t expected = STATE_WAITING;
+    if (state_.compare_exchange_strong(expected, STATE_PENDING))
+        wakeAll();
 }
@@ -8,118 +8,325 @@
 #include <stddef.h>
 #include <thread>
 #include <queue>
+#include <deque>
 #include <memory>
 #include <atomic>
 #include <mutex>//互斥锁
+#include <shared_mutex>
 #include <condition_variable>//条件变量
 #include <functional>
 #include <unordered_map>
+#include <chrono>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <exception>
+#include <new>
+#include <cstddef>
+#include <stdint.h>
+
+#include "poolstats.h"
+#include "poolalloc.h"
+#include "timerwheel.h"
 
 //Any 类型： 可以接收任意数据的类型 C++17中any类型的关键
+//只能移动 小的、移动不抛异常的类型(整数、指针、std::vector等)直接存放在对象内部 不申请堆内存
+//其他类型存放在PoolArena中 移动Any只是转移指针 不拷贝数据
 class Any
 {
 public:
     Any() = default;
-    ~Any() = default;
+    ~Any()
+    {
+        reset();
+    }
     Any(const Any&) = delete;
     Any& operator=(const Any&) = delete;//左值引用和右值引用的拷贝构造
-    Any(Any&&) = default;//右值引用的拷贝构造
-    Any& operator=(Any&&) = default;
+    Any(Any&& other) noexcept//右值引用的拷贝构造
+    {
+        moveFrom(other);
+    }
+    Any& operator=(Any&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
 
+    //这个构造函数可以让any接收任意数据 右值直接移动进来
+    template<typename T, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<T>::type, Any>::value>::type>
+    Any(T&& data)
+    {
+        using U = typename std::decay<T>::type;
+        if constexpr (Ops<U>::isInline)
+            new (storage_.buf_) U(std::forward<T>(data));
+        else
+            storage_.ptr_ = PoolArena::create<U>(std::forward<T>(data));
+        ops_ = &Ops<U>::table;
+    }
+
+    //这个方法又能把any里存储的对象数据取出来 拷贝一份
     template<typename T>
-    Any(T data) : base_(std::make_unique<Derive<T>>(data))
-    {} 
+    T cast_() &
+    {
+        return *data<T>();
+    }
 
-    //这个方法又能把any里存储的对象数据取出来
+    //Any是右值时(例如res.get().cast_<T>()) 直接把数据移动出来 不拷贝
     template<typename T>
-    T cast_()
+    T cast_() &&
     {
-        //怎么从base_中找到它所指向的Derive对象，从他里面取出data成员变量
-        //基类指针转换成派生类指针 RTTI类型识别
-        Derive<T>* pd = dynamic_cast<Derive<T>*>(base_.get());//取出智能指针的裸指针
-        if (pd == nullptr)
-        {
-            //转换失败，基类和派生类不对应
-            throw "type is unmatch!";
-        }
-        return pd->data_;
+        return std::move(*data<T>());
+    }
+
+    bool has_value() const
+    {
+        return ops_ != nullptr;
     }
 
 private:
-    //基类类型
-    class Base
+    //对象内部存储区 放得下三个指针大小的数据
+    union Storage
     {
-    public:
-        virtual ~Base() = default;
+        void* ptr_;
+        alignas(std::max_align_t) unsigned char buf_[3 * sizeof(void*)];
+    };
+
+    //每种类型一张操作表 表的地址就是类型标识 比较地址代替dynamic_cast
+    struct OpsTable
+    {
+        void (*destroy)(Storage& storage);
+        void (*move)(Storage& from, Storage& to);
+        void* (*get)(Storage& storage);
     };
 
-    //派生类类型//这个构造函数可以让any接收任意数据
     template<typename T>
-    class Derive : public Base
+    struct Ops
     {
-    public:
-        Derive(T data) : data_(data)
-        {}
-        T data_; //基类指针的派生类对象里 保存了其他任意类型的
+        static constexpr bool isInline = sizeof(T) <= sizeof(Storage)
+            && alignof(T) <= alignof(Storage)
+            && std::is_nothrow_move_constructible<T>::value;
+
+        static void destroy(Storage& storage)
+        {
+            if constexpr (isInline)
+                get(storage)->~T();
+            else
+                PoolArena::destroy(get(storage));
+        }
+        static void move(Storage& from, Storage& to)
+        {
+            if constexpr (isInline)
+            {
+                new (to.buf_) T(std::move(*get(from)));
+                get(from)->~T();
+            }
+            else
+            {
+                to.ptr_ = from.ptr_;
+            }
+        }
+        static T* get(Storage& storage)
+        {
+            if constexpr (isInline)
+                return reinterpret_cast<T*>(storage.buf_);
+            return static_cast<T*>(storage.ptr_);
+        }
+        static void* getVoid(Storage& storage)
+        {
+            return get(storage);
+        }
+        static const OpsTable table;
     };
-    
+
+    template<typename T>
+    T* data()
+    {
+        if (ops_ != &Ops<T>::table)
+        {
+            //转换失败，存入的类型和取出的类型不对应
+            throw "type is unmatch!";
+        }
+        return static_cast<T*>(ops_->get(storage_));
+    }
+
+    void moveFrom(Any& other) noexcept
+    {
+        if (other.ops_ != nullptr)
+        {
+            other.ops_->move(other.storage_, storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    void reset()
+    {
+        if (ops_ != nullptr)
+        {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
 private:
-    //定义基类的指针
-    std::unique_ptr<Base> base_;
+    Storage storage_;
+    const OpsTable* ops_ = nullptr;
 };
 
-// 实现信号量类
-class Semaphore
+template<typename T>
+const Any::OpsTable Any::Ops<T>::table = { &Any::Ops<T>::destroy, &Any::Ops<T>::move, &Any::Ops<T>::getVoid };
+
+// 一次性完成通知 任务执行完set一次 之后所有wait都立即返回
+// 状态只是一个原子整数：没有人等待时set只是一次原子写 不加锁也不通知
+// 有人等待时才用futex(Linux)睡眠和唤醒 其他平台用按地址分散的一组互斥锁和条件变量
+class Completion
 {
 public:
-    Semaphore(int limit = 0)
-        :resLimit_(limit)
+    Completion()
+        : state_(STATE_PENDING)
     {}
-    ~Semaphore() = default;
+    ~Completion() = default;
+    Completion(const Completion&) = delete;
+    Completion& operator=(const Completion&) = delete;
 
-    // 获取一个信号量资源
+    // 标记完成 只有登记过的等待者存在时才需要系统调用唤醒
+    void set()
+    {
+        if (state_.exchange(STATE_DONE, std::memory_order_acq_rel) == STATE_WAITING)
+        {
+            wakeAll();
+        }
+    }
+
+    // 阻塞等待完成
     void wait()
     {
-        std::unique_lock<std::mutex> lock(mtx_);
-        // 等待信号量有资源，没有资源的话，会阻塞当前线程
-        cond_.wait(lock, [&]()->bool {return resLimit_ > 0; });
-        resLimit_--;
+        if (!ready())
+            waitFor(-1);
+    }
+
+    // 最多等待一段时间 返回是否已完成
+    template<typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        if (ready())
+            return true;
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+        return waitFor(ns < 0 ? 0 : ns);
     }
 
-    // 增加一个信号量资源
-    void post()
+    bool ready() const
     {
-        std::unique_lock<std::mutex> lock(mtx_);
-        resLimit_++;
-        // linux下condition_variable的析构函数什么也没做
-        // 导致这里状态已经失效，无故阻塞
-        cond_.notify_all();  // 等待状态，释放mutex锁 通知条件变量wait的地方，可以起来干活了
+        return state_.load(std::memory_order_acquire) == STATE_DONE;
     }
+
 private:
-    int resLimit_;
-    std::mutex mtx_;
-    std::condition_variable cond_;
+    friend class ThreadPool;
+
+    // 慢路径 登记等待后睡眠 timeoutNs < 0 表示一直等待 定义在threadpool.cpp中
+    bool waitFor(long long timeoutNs);
+    void wakeAll();
+
+    // 工作线程等待时使用：arm登记等待者 已完成返回false 之后检查过没有任务可执行才调用sleepOnce
+    // sleepOnce在完成或者被interrupt时返回 interrupt把登记撤销 还没睡下的sleepOnce也会立即返回
+    bool arm();
+    void sleepOnce();
+    void interrupt();
+
+    static const uint32_t STATE_PENDING = 0; //未完成 没有等待者
+    static const uint32_t STATE_DONE = 1;    //已完成
+    static const uint32_t STATE_WAITING = 2; //未完成 有等待者在睡眠
+    std::atomic<uint32_t> state_;
 };
 
 //Task类型的前置声明
 class Task;
+class ThreadPool;
+class TaskCombiner;
+
+//线程池的共享句柄 后续任务、when_all/when_any、任务图和协程通过它把任务提交到线程池
+//线程池析构时关闭句柄 之后提交都失败 由调用者在当前线程执行 比线程池活得久的Result不会访问已经析构的线程池
+class PoolHandle
+{
+public:
+    explicit PoolHandle(ThreadPool* pool);
+    PoolHandle(const PoolHandle&) = delete;
+    PoolHandle& operator=(const PoolHandle&) = delete;
+
+    //不使用拒绝策略提交任务 线程池已经析构或者队列满时返回false
+    bool trySubmitTask(const std::shared_ptr<Task>& sp);
+
+    //线程池还没有析构时在共享锁内调用func(ThreadPool&) 线程池已经析构时返回false
+    template<typename F>
+    bool withPool(F&& func)
+    {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        if (pool_ == nullptr)
+            return false;
+        func(*pool_);
+        return true;
+    }
+
+private:
+    friend class ThreadPool;
+
+    //线程池析构时调用 等正在进行的提交结束后返回
+    void close();
+
+    std::shared_mutex mtx_; //提交时共享持有 关闭时独占
+    ThreadPool* pool_;      //关闭后为nullptr
+};
+
+//等待done完成 在线程池的工作线程上调用时不让线程睡眠 而是执行这个线程池里排队的任务直到完成
+//awaited是被等待的任务 它还在队列里没有开始执行时当前线程直接执行它
+//任务里等待子任务的结果(递归分治)不会因为所有线程都在等待而死锁 非线程池线程直接阻塞等待
+void helpWait(Completion& done, Task* awaited = nullptr);
+class TaskGraph;
+//Result<T>: 任务返回值的类型 默认的Result<Any>接收从Task继承的任务的返回值
+template<typename T = Any>
+class Result;
+//co_await Result的等待体 定义在coroutine.h中
+template<typename T>
+class ResultAwaiter;
+
 //实现接收 提交到线程池的task任务执行完毕后的返回值类型 Result
-class Result
+//返回值和完成状态都存放在task对象里 Result只持有task的智能指针 可以安全地移动
+template<>
+class Result<Any>
 {
 public:
     Result(std::shared_ptr<Task> task, bool isValid = true);
     ~Result() = default;
+    Result(Result&&) = default;
+    Result& operator=(Result&&) = default;
+    Result(const Result&) = delete;
+    Result& operator=(const Result&) = delete;
 
-    //setvalue 获取任务的返回值
-    void setVal(Any any);
-
-    //如何提供get方法给用户层调用
+    //如何提供get方法给用户层调用 阻塞等待task执行完 取出返回值
     Any get();
+
+    //阻塞等待任务执行完
+    void wait();
+
+    //最多等待一段时间 返回任务是否已执行完
+    template<typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout);
+
+    //任务是否已执行完 不阻塞
+    bool ready() const;
+
+    //任务是否提交成功 并且没有因为超过截止时间或者拒绝策略被丢弃
+    bool valid() const;
 private:
-    Any any_;//存储返回值
-    Semaphore sema_;//信号量
+    friend class ResultAwaiter<Any>;
+
     std::shared_ptr<Task>task_;//指向对应获取返回值的任务对象
-    std::atomic_bool isValid_;//返回值是否有效，比如任务是否提交成功的情况
+    bool isValid_;//返回值是否有效，比如任务是否提交成功的情况
 };
 
 /*实现选择模式*/
@@ -127,24 +334,555 @@ enum class PoolMode    //enum枚举类型//给枚举项加上类型，可杜绝
 {
     MODE_FIXED,  //固定数量线程
     MODE_CACHED, //可变数量 动态增长
+    MODE_STEALING, //固定数量线程 每个线程有自己的双端任务队列 空闲线程从其他线程窃取任务
+};
+
+/*任务队列的实现方式*/
+enum class TaskQueMode
+{
+    QUE_LOCKED,   //std::queue + 互斥锁
+    //有界无锁环形队列 容量取任务队列上限阈值的两倍 只有线程需要睡眠时才用锁和条件变量
+    //上限阈值最大65536 没有设置阈值(默认不限制)或者设置得更大时按65536截断 排队超过65536个任务时按拒绝策略处理
+    QUE_LOCKFREE,
+};
+
+/*线程绑核方式*/
+enum class ThreadAffinity
+{
+    AFFINITY_NONE,     //不绑定 由操作系统调度
+    AFFINITY_CPUSET,   //所有线程限制在指定的CPU集合内
+    AFFINITY_PER_CORE, //每个线程绑定一个物理核 跳过超线程兄弟 线程比物理核多时轮流复用
+};
+
+/*任务队列满时submitTask/submit/submitBatch的处理方式 trySubmitTask/trySubmit不受影响*/
+enum class RejectPolicy
+{
+    REJECT_ABORT,          //立即提交失败 返回无效的Result 过载时尽快甩掉负载
+    REJECT_CALLER_RUNS,    //由提交任务的线程自己执行 Result有效 提交方被拖慢 自然地降低提交速度
+    REJECT_DISCARD_OLDEST, //淘汰全局队列中最早的任务腾出位置 被淘汰任务的Result变为无效
+    REJECT_BLOCK,          //阻塞等待队列有空位 超过等待时间后提交失败 默认 最多等待一秒
+};
+
+/*任务优先级 只有通过带优先级或截止时间的submitTask/submit提交时才生效*/
+enum class TaskPriority
+{
+    PRIORITY_HIGH,   //先于普通任务执行 例如对延迟敏感的请求
+    PRIORITY_NORMAL, //默认优先级
+    PRIORITY_LOW,    //普通任务都执行完才执行 等待超过老化时间后提前执行 例如批量的后台任务
 };
 
 /*任务抽象 基类*/
 //用户自定义任务类型，从Task继承，重写run方法，实现自定义任务处理
+//返回值和完成状态存放在task对象里 一个task对象只能提交一次
 class Task
 {
 public:
     Task();
-    ~Task() = default;
+    ~Task();
     void exec();
-    void setResult(Result* res);
     //用户自定义任务类型，从Task继承，重写run方法，实现自定义任务处理
     virtual Any run() = 0; //修饰虚函数
 
+    //任务执行完(或者被丢弃)后调用func 已经执行完则在当前线程立即调用
+    //func在完成任务的线程上执行 应该很短 例如把后续任务提交到线程池
+    void addContinuation(std::function<void()> func);
+
+protected:
+    //exec实际调用的执行函数 ThreadPool::submit生成的任务不经过虚函数run和Any
+    using ExecFunc = void(*)(Task*);
+    Task(ExecFunc func);
+
+    //通知Result任务已经完成 然后执行登记的后续回调
+    void complete();
+
+    Completion done_; //任务执行完毕的通知
+
 private:
-    Result* result_;
+    template<typename U>
+    friend class Result;
+    template<typename U>
+    friend class ValueTask;
+    friend class ThreadPool;
+    friend class TaskCombiner;
+    friend class TaskGraph;
+    friend class IoEngine;
+    friend class TaskBatcher;
+    friend class GroupScheduler;
+    template<typename U>
+    friend class ResultAwaiter;
+
+    //默认的执行函数 调用run并把返回值存起来
+    static void execRun(Task* task);
+
+    //后续回调的单链表节点 任务完成时整条链表被取走 之后头指针指向closedList
+    struct Continuation
+    {
+        std::function<void()> func_;
+        Continuation* next_;
+
+        static void* operator new(size_t size)
+        {
+            return PoolArena::allocate(size);
+        }
+        static void operator delete(void* ptr, size_t size)
+        {
+            PoolArena::deallocate(ptr, size);
+        }
+    };
+    static Continuation closedList;
+
+    ExecFunc execFunc_;
+    std::atomic<Continuation*> continuations_{ nullptr }; //登记的后续回调 后登记的在链表头
+    std::shared_ptr<PoolHandle> pool_; //任务提交到的线程池的句柄 后续任务提交到同一个线程池
+    Any value_; //run的返回值
+    uint64_t enqueueTime_ = 0; //入队时间 开启任务计时时才记录
+    TaskPriority priority_ = TaskPriority::PRIORITY_NORMAL; //优先级
+    uint64_t deadline_ = UINT64_MAX; //截止时间 steady_clock纳秒 UINT64_MAX表示没有截止时间
+    std::atomic_bool expired_{ false }; //超过截止时间没有执行 被线程池丢弃
+    std::atomic_bool dropped_{ false }; //队列满时被REJECT_DISCARD_OLDEST淘汰 没有执行
+    //入队状态 等待结果的工作线程可以直接执行还在排队的任务 队列里的那一份取出后不再执行
+    static const int RUN_IDLE = 0;    //还没有入队
+    static const int RUN_QUEUED = 1;  //在队列里等待执行
+    static const int RUN_STARTED = 2; //已经被某个线程取走执行
+    std::atomic_int runState_{ RUN_IDLE };
+
+    //入队成功后标记为排队中 已经被工作线程取走执行的不改
+    void markQueued()
+    {
+        int expected = RUN_IDLE;
+        runState_.compare_exchange_strong(expected, RUN_QUEUED);
+    }
+    //从排队中认领任务 由等待它的线程直接执行 成功返回true
+    bool claim()
+    {
+        int expected = RUN_QUEUED;
+        return runState_.compare_exchange_strong(expected, RUN_STARTED);
+    }
+    bool droppable_ = false; //按REJECT_DISCARD_OLDEST提交的任务可以被淘汰 线程池内部依赖的任务不能
+    int node_ = -1; //NUMA节点提示 -1表示没有
+};
+
+template<typename Rep, typename Period>
+bool Result<Any>::wait_for(const std::chrono::duration<Rep, Period>& timeout)
+{
+    return isValid_ && task_->done_.wait_for(timeout);
+}
+
+//ThreadPool::submit提交的任务 返回值直接存放在任务对象里
+//Result<T>与线程池共同持有这个对象 不需要Any和dynamic_cast 也不需要额外的堆内存
+template<typename T>
+class ValueTask : public Task
+{
+public:
+    //不会被调用 执行函数由派生类FuncTask提供
+    Any run() override { return Any(); }
+
+protected:
+    ValueTask(ExecFunc func)
+        : Task(func)
+    {}
+
+private:
+    template<typename U>
+    friend class Result;
+    template<typename U, typename F>
+    friend class FuncTask;
+    friend class TaskCombiner;
+
+    //任务完成后取出返回值 任务抛出了异常或者被丢弃时抛出异常 只能调用一次
+    T takeValue()
+    {
+        if (this->expired_)
+        {
+            throw "task deadline expired!";
+        }
+        if (this->dropped_)
+        {
+            throw "task dropped by reject policy!";
+        }
+        if (error_)
+        {
+            std::rethrow_exception(error_);
+        }
+        if constexpr (!std::is_void<T>::value)
+        {
+            return std::move(*value_);
+        }
+    }
+
+    //void返回值只需要完成通知
+    using Value = typename std::conditional<std::is_void<T>::value, bool, T>::type;
+    std::optional<Value> value_;//存储返回值
+    std::exception_ptr error_;  //任务抛出的异常 在get时重新抛出
+};
+
+//把用户的可调用对象原地存放在任务对象中
+template<typename T, typename F>
+class FuncTask : public ValueTask<T>
+{
+public:
+    FuncTask(F&& func)
+        : ValueTask<T>(&FuncTask::execFunc)
+        , func_(std::move(func))
+    {}
+
+private:
+    static void execFunc(Task* task)
+    {
+        FuncTask* self = static_cast<FuncTask*>(task);
+        try
+        {
+            if constexpr (std::is_void<T>::value)
+            {
+                (*self->func_)();
+                self->value_.emplace(true);
+            }
+            else
+            {
+                self->value_.emplace((*self->func_)());
+            }
+        }
+        catch (...)
+        {
+            self->error_ = std::current_exception();
+        }
+        self->func_.reset();//执行完及时释放可调用对象捕获的资源
+        self->complete();
+    }
+
+    std::optional<F> func_;
+};
+
+//Result<T>::then的后续任务的返回值类型 前一个任务返回void时后续函数不接收参数
+template<typename T, typename F>
+struct ThenResult
+{
+    using type = typename std::invoke_result<typename std::decay<F>::type, T>::type;
+};
+template<typename F>
+struct ThenResult<void, F>
+{
+    using type = typename std::invoke_result<typename std::decay<F>::type>::type;
 };
 
+//ThreadPool::submit的返回值 类似std::future 只能移动
+template<typename T>
+class Result
+{
+public:
+    Result(std::shared_ptr<ValueTask<T>> task, bool isValid = true)
+        : task_(std::move(task))
+        , isValid_(isValid)
+    {}
+    ~Result() = default;
+    Result(Result&&) = default;
+    Result& operator=(Result&&) = default;
+    Result(const Result&) = delete;
+    Result& operator=(const Result&) = delete;
+
+    //阻塞等待任务执行完 取出返回值 只能调用一次
+    T get()
+    {
+        if (!isValid_)
+        {
+            throw "task submit fail!";
+        }
+        helpWait(task_->done_, task_.get());
+        return task_->takeValue();
+    }
+
+    //任务执行完后把返回值交给func 作为新任务提交到同一个线程池 不阻塞任何线程
+    //返回值被后续任务取走 所以调用后这个Result不再有效: auto r2 = std::move(r1).then(f);
+    //前一个任务抛出异常或者被丢弃时不调用func 异常传给返回的Result
+    //线程池析构后后续任务不再提交 在完成前一个任务的线程或者调用then的线程上直接执行
+    template<typename F>
+    auto then(F&& func) && -> Result<typename ThenResult<T, F>::type>;
+
+    //阻塞等待任务执行完
+    void wait()
+    {
+        if (isValid_)
+            helpWait(task_->done_, task_.get());
+    }
+
+    //最多等待一段时间 返回任务是否已执行完
+    template<typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        return isValid_ && task_->done_.wait_for(timeout);
+    }
+
+    //任务是否已执行完 不阻塞
+    bool ready() const
+    {
+        return isValid_ && task_->done_.ready();
+    }
+
+    //任务是否提交成功 并且没有因为超过截止时间或者拒绝策略被丢弃
+    bool valid() const
+    {
+        return isValid_ && !task_->expired_ && !task_->dropped_;
+    }
+
+private:
+    template<typename U>
+    friend class Result;
+    friend class TaskCombiner;
+    friend class ResultAwaiter<T>;
+
+    std::shared_ptr<ValueTask<T>> task_;
+    bool isValid_;
+};
+
+//批量提交的返回值 results与提交的任务一一对应
+//任务队列放不下整批任务时只接受前accepted()个 其余任务不会执行 它们的Result无效
+template<typename T = Any>
+class BatchResult
+{
+public:
+    BatchResult(std::vector<Result<T>> results, size_t accepted)
+        : results_(std::move(results))
+        , accepted_(accepted)
+    {}
+    ~BatchResult() = default;
+    BatchResult(BatchResult&&) = default;
+    BatchResult& operator=(BatchResult&&) = default;
+
+    //提交的任务数量
+    size_t size() const
+    {
+        return results_.size();
+    }
+
+    //被接受的任务数量
+    size_t accepted() const
+    {
+        return accepted_;
+    }
+
+    //整批任务是否全部被接受
+    bool allAccepted() const
+    {
+        return accepted_ == results_.size();
+    }
+
+    Result<T>& operator[](size_t index)
+    {
+        return results_[index];
+    }
+
+    std::vector<Result<T>>& results()
+    {
+        return results_;
+    }
+
+    //等待所有被接受的任务执行完
+    void wait()
+    {
+        for (size_t i = 0; i < accepted_; i++)
+        {
+            results_[i].wait();
+        }
+    }
+
+private:
+    std::vector<Result<T>> results_;
+    size_t accepted_;
+};
+
+//when_all/when_any的实现 组合任务只是移动各个任务的返回值 不提交到线程池
+//由最后一个(when_any是第一个)完成的输入任务所在的线程直接执行
+class TaskCombiner
+{
+public:
+    //void返回值用bool占位
+    template<typename T>
+    using ValueOf = typename std::conditional<std::is_void<T>::value, bool, T>::type;
+    template<typename T>
+    using AllType = typename std::conditional<std::is_void<T>::value, void, std::vector<T>>::type;
+    template<typename T>
+    using AnyType = typename std::conditional<std::is_void<T>::value, size_t, std::pair<size_t, ValueOf<T>>>::type;
+
+    template<typename T>
+    static Result<AllType<T>> all(std::vector<Result<T>> results)
+    {
+        using R = AllType<T>;
+        std::vector<std::shared_ptr<ValueTask<T>>> tasks;
+        if (!takeTasks(results, tasks))
+            return Result<R>(nullptr, false);
+
+        auto call = [tasks]() -> R
+        {
+            if constexpr (std::is_void<T>::value)
+            {
+                for (auto& task : tasks)
+                    task->takeValue();
+            }
+            else
+            {
+                R values;
+                values.reserve(tasks.size());
+                for (auto& task : tasks)
+                    values.push_back(task->takeValue());
+                return values;
+            }
+        };
+        auto combined = allocateShared<FuncTask<R, decltype(call)>>(std::move(call));
+        std::vector<Task*> inputs;
+        for (auto& task : tasks)
+            inputs.push_back(task.get());
+        runAfterAll(combined, inputs);
+        return Result<R>(std::move(combined), true);
+    }
+
+    template<typename... Ts>
+    static Result<std::tuple<ValueOf<Ts>...>> all(Result<Ts>&&... results)
+    {
+        using R = std::tuple<ValueOf<Ts>...>;
+        if (!(results.isValid_ && ...))
+            return Result<R>(nullptr, false);
+        auto tasks = std::make_tuple(std::move(results.task_)...);
+        ((results.isValid_ = false), ...);
+
+        auto call = [tasks]() -> R
+        {
+            //花括号初始化保证按参数顺序取值 抛出的是顺序上第一个异常
+            return std::apply([](auto&... task) { return R{ takeOf(*task)... }; }, tasks);
+        };
+        auto combined = allocateShared<FuncTask<R, decltype(call)>>(std::move(call));
+        std::vector<Task*> inputs = std::apply([](auto&... task) { return std::vector<Task*>{ task.get()... }; }, tasks);
+        runAfterAll(combined, inputs);
+        return Result<R>(std::move(combined), true);
+    }
+
+    template<typename T>
+    static Result<AnyType<T>> any(std::vector<Result<T>> results)
+    {
+        using R = AnyType<T>;
+        std::vector<std::shared_ptr<ValueTask<T>>> tasks;
+        if (results.empty() || !takeTasks(results, tasks))
+            return Result<R>(nullptr, false);
+
+        //第一个完成的任务的下标
+        auto first = allocateShared<std::atomic<size_t>>(SIZE_MAX);
+        auto call = [tasks, first]() -> R
+        {
+            size_t index = first->load();
+            if constexpr (std::is_void<T>::value)
+            {
+                tasks[index]->takeValue();
+                return index;
+            }
+            else
+            {
+                return R(index, tasks[index]->takeValue());
+            }
+        };
+        auto combined = allocateShared<FuncTask<R, decltype(call)>>(std::move(call));
+        combined->pool_ = tasks.front()->pool_;
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            tasks[i]->addContinuation([combined, first, i]() {
+                size_t expected = SIZE_MAX;
+                if (first->compare_exchange_strong(expected, i))
+                    combined->exec();
+            });
+        }
+        return Result<R>(std::move(combined), true);
+    }
+
+private:
+    //取出所有Result持有的任务 有任何一个Result无效时不取
+    template<typename T>
+    static bool takeTasks(std::vector<Result<T>>& results, std::vector<std::shared_ptr<ValueTask<T>>>& tasks)
+    {
+        for (auto& res : results)
+        {
+            if (!res.isValid_)
+                return false;
+        }
+        tasks.reserve(results.size());
+        for (auto& res : results)
+        {
+            tasks.push_back(std::move(res.task_));
+            res.isValid_ = false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    static ValueOf<T> takeOf(ValueTask<T>& task)
+    {
+        if constexpr (std::is_void<T>::value)
+        {
+            task.takeValue();
+            return true;
+        }
+        else
+        {
+            return task.takeValue();
+        }
+    }
+
+    //所有输入任务完成后 在最后完成的线程上执行组合任务
+    static void runAfterAll(const std::shared_ptr<Task>& combined, const std::vector<Task*>& inputs)
+    {
+        if (inputs.empty())
+        {
+            combined->exec();
+            return;
+        }
+        combined->pool_ = inputs.front()->pool_;
+        auto pending = allocateShared<std::atomic<size_t>>(inputs.size());
+        for (Task* input : inputs)
+        {
+            input->addContinuation([combined, pending]() {
+                if (pending->fetch_sub(1) == 1)
+                    combined->exec();
+            });
+        }
+    }
+};
+
+//所有任务都完成后就绪 返回值按顺序放在vector里 void任务返回Result<void>
+//任何一个任务抛出异常时get重新抛出顺序上第一个异常 输入的Result被取走: when_all(std::move(results))
+template<typename T>
+Result<TaskCombiner::AllType<T>> when_all(std::vector<Result<T>> results)
+{
+    return TaskCombiner::all(std::move(results));
+}
+
+//不同类型的任务都完成后就绪 返回值放在tuple里 void任务的位置是bool
+//例: auto r = when_all(std::move(r1), std::move(r2)); auto [a, b] = r.get();
+template<typename... Ts>
+Result<std::tuple<TaskCombiner::ValueOf<Ts>...>> when_all(Result<Ts>&&... results)
+{
+    return TaskCombiner::all(std::move(results)...);
+}
+
+//任何一个任务完成后就绪 返回(下标, 返回值) void任务只返回下标
+//其余任务照常执行 它们的返回值被丢弃
+template<typename T>
+Result<TaskCombiner::AnyType<T>> when_any(std::vector<Result<T>> results)
+{
+    return TaskCombiner::any(std::move(results));
+}
+
+//任务队列的存储 节点内存从PoolArena分配
+using TaskDeque = std::deque<std::shared_ptr<Task>, PoolAllocator<std::shared_ptr<Task>>>;
+
+//工作窃取模式下每个线程私有的双端队列 定义在threadpool.cpp中
+class WorkStealQueue;
+//任务组的调度器 定义在taskgroup.cpp中
+class GroupScheduler;
+//每个线程在每个线程池里的统计计数 定义在threadpool.cpp中
+class StatsBlock;
+//优先级任务队列 定义在threadpool.cpp中
+class PriorityTaskQueue;
+//无锁环形队列 定义在ringqueue.h中
+template<typename T>
+class RingQueue;
+
 //线程类型
 class Thread
 {
@@ -174,6 +912,21 @@ class MyTask : public Task
 };
 
 pool.submitTask(std::make_shared<MyTask>());
+
+不需要继承Task 直接提交函数 拿到带类型的返回值:
+Result<int> res = pool.submit([](int a, int b) { return a + b; }, 1, 2);
+int sum = res.get();
+
+按优先级和截止时间提交:
+pool.submit(TaskPriority::PRIORITY_HIGH, handleRequest, req);
+pool.submitTask(std::make_shared<MyTask>(), TaskPriority::PRIORITY_LOW);
+pool.submitTask(std::make_shared<MyTask>(), std::chrono::steady_clock::now() + std::chrono::milliseconds(50));
+
+过载时快速拒绝 不阻塞提交线程:
+pool.settaskQueMaxThreshHold(1024);
+pool.setRejectPolicy(RejectPolicy::REJECT_ABORT);
+auto res = pool.trySubmit(handleRequest, req);
+if (!res.valid()) { ... 返回繁忙 ... }
 */
 
 /*线程池类型*/
@@ -186,31 +939,415 @@ public:
     //设置线程池工作模式
     void setMode(PoolMode mode);
 
+    //设置空闲线程睡眠前的自旋次数 默认0表示直接睡眠
+    //自旋可以让突发的短任务不经过睡眠唤醒就被执行 降低延迟 代价是空闲时多消耗CPU
+    void setSpinCount(int count);
+
     /*
     //设置初始线程数量
     void setInitThreadSize(int size);
     */
 
-    //设置task任务队列上限阈值
+    //设置task任务队列上限阈值 默认不限制
+    //QUE_LOCKFREE模式下最大65536 更大的值在start时截断并输出警告日志
     void settaskQueMaxThreshHold(int threshhold);
 
+    //设置任务队列满时的拒绝策略 blockTime是REJECT_BLOCK的最长等待时间
+    void setRejectPolicy(RejectPolicy policy, std::chrono::milliseconds blockTime = std::chrono::seconds(1));
+
+    //设置任务队列的实现方式
+    void settaskQueMode(TaskQueMode mode);
+
     //设置线程池cache模式下线程上限阈值
     void setthreadSizeThreshHold(int threshhold);
 
-    //给线程池提交任务
-    Result submitTask(std::shared_ptr<Task> sp);//让用户直接传智能指针进来，规避生命周期太短的任务。
+    //设置cache模式下保留的最少线程数量 小于0表示start时的初始线程数量(默认)
+    void setMinThreadSize(int size);
+
+    //设置cache模式下多余线程的保活时间 整个保活时间内一直空闲的线程才会被回收 默认60秒
+    void setThreadKeepAlive(std::chrono::milliseconds keepAlive);
+
+    //设置cache模式下可以接受的排队时间 按最近吞吐量估算的排队时间超过它时才扩容 默认1毫秒
+    void setTargetQueueWait(std::chrono::microseconds wait);
+
+    //设置低优先级任务的老化时间 等待超过这个时间的低优先级任务先于普通任务执行 0表示不老化 默认100毫秒
+    void setPriorityAging(std::chrono::milliseconds aging);
+
+    //开启后 取出任务时已经超过截止时间的任务直接丢弃 不占用线程执行 它的Result变为无效
+    void setDropExpiredTasks(bool enable);
+
+    //设置线程绑核方式 cpus为空表示所有在线CPU 只在Linux下生效
+    void setThreadAffinity(ThreadAffinity affinity, const std::vector<int>& cpus = std::vector<int>());
+
+    //开启NUMA感知：线程按节点轮流分配并限制在所在节点的CPU上 每个节点一个任务队列
+    //带节点提示提交的任务优先由该节点的线程执行 只有一个节点的机器上不起作用
+    void setNumaAware(bool enable);
+
+    //给线程池提交任务 队列满时按拒绝策略处理
+    Result<> submitTask(std::shared_ptr<Task> sp);//让用户直接传智能指针进来，规避生命周期太短的任务。
+
+    //尝试提交任务 队列满时最多等待timeout(默认不等待) 仍然放不下就返回无效的Result 不使用拒绝策略
+    //这样提交的任务不会被REJECT_DISCARD_OLDEST淘汰
+    Result<> trySubmitTask(std::shared_ptr<Task> sp, std::chrono::nanoseconds timeout = std::chrono::nanoseconds(0));
+
+    //在线程池的内存(PoolArena)中构造任务 任务对象和引用计数在同一块内存中 释放后被之后的任务复用
+    //例: auto task = ThreadPool::makeTask<MyTask>(1, 100); pool.submitTask(task);
+    template<typename T, typename... Args>
+    static std::shared_ptr<T> makeTask(Args&&... args)
+    {
+        return allocateShared<T>(std::forward<Args>(args)...);
+    }
+
+    //在线程池的内存中构造任务并提交
+    template<typename T, typename... Args>
+    Result<> emplaceTask(Args&&... args)
+    {
+        return submitTask(makeTask<T>(std::forward<Args>(args)...));
+    }
+
+    //按优先级提交任务 同一优先级内截止时间早的先执行(EDF) 没有截止时间的按提交顺序排在后面
+    //调度顺序：高优先级 -> 等待超过老化时间的低优先级 -> 普通优先级 -> 低优先级
+    Result<> submitTask(std::shared_ptr<Task> sp, TaskPriority priority,
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+    //带截止时间提交任务 普通优先级
+    Result<> submitTask(std::shared_ptr<Task> sp, std::chrono::steady_clock::time_point deadline);
+
+    //带NUMA节点提示提交任务 节点编号见CpuTopology 该节点的线程先取这个任务 它们都在忙时其他节点的线程也会取
+    //没有开启NUMA感知或节点不存在时和submitTask(sp)一样
+    Result<> submitTask(std::shared_ptr<Task> sp, int node);
+
+    //提交任意可调用对象和参数 返回带类型的Result<T>
+    //例: Result<int> res = pool.submit([](int a, int b) { return a + b; }, 1, 2);
+    template<typename Func, typename... Args>
+    auto submit(Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        using RType = typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type;
+        std::shared_ptr<ValueTask<RType>> task = makeFuncTask(std::forward<Func>(func), std::forward<Args>(args)...);
+        bool isValid = enqueueTask(task, policyAdmission());
+        return Result<RType>(std::move(task), isValid);
+    }
+
+    //尝试提交可调用对象 队列满时立即返回无效的Result
+    template<typename Func, typename... Args>
+    auto trySubmit(Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        return trySubmitFor(std::chrono::nanoseconds(0), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    //尝试提交可调用对象 队列满时最多等待timeout
+    template<typename Func, typename... Args>
+    auto trySubmitFor(std::chrono::nanoseconds timeout, Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        using RType = typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type;
+        std::shared_ptr<ValueTask<RType>> task = makeFuncTask(std::forward<Func>(func), std::forward<Args>(args)...);
+        Admission admission;
+        admission.timeout_ = timeout;
+        bool isValid = enqueueTask(task, admission);
+        return Result<RType>(std::move(task), isValid);
+    }
+
+    //按优先级提交可调用对象 调度规则同submitTask
+    template<typename Func, typename... Args>
+    auto submit(TaskPriority priority, Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        return submit(priority, std::chrono::steady_clock::time_point::max(),
+            std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    //按优先级和截止时间提交可调用对象 任务被丢弃时Result::get抛出异常
+    template<typename Func, typename... Args>
+    auto submit(TaskPriority priority, std::chrono::steady_clock::time_point deadline, Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        using RType = typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type;
+        std::shared_ptr<ValueTask<RType>> task = makeFuncTask(std::forward<Func>(func), std::forward<Args>(args)...);
+        setTaskPriority(task.get(), priority, deadline);
+        bool isValid = enqueueTask(task, policyAdmission());
+        return Result<RType>(std::move(task), isValid);
+    }
+
+    //带NUMA节点提示提交可调用对象 例如处理在这个节点上分配的数据
+    template<typename Func, typename... Args>
+    auto submitToNode(int node, Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        using RType = typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type;
+        std::shared_ptr<ValueTask<RType>> task = makeFuncTask(std::forward<Func>(func), std::forward<Args>(args)...);
+        task->node_ = node;
+        bool isValid = enqueueTask(task, policyAdmission());
+        return Result<RType>(std::move(task), isValid);
+    }
+
+    //延时提交任务 delay之后放入任务队列 到期的任务由定时器线程成批放入队列
+    //到期时队列已满的任务计入rejected 推迟到下一个刻度再放 不会丢失
+    //线程池析构时还没到期的任务被丢弃 Result::get抛出异常
+    Result<> submitTaskAfter(std::chrono::nanoseconds delay, std::shared_ptr<Task> sp);
+
+    //在time时刻提交任务
+    Result<> submitTaskAt(std::chrono::steady_clock::time_point time, std::shared_ptr<Task> sp);
+
+    //延时提交可调用对象
+    //例: Result<int> res = pool.submitAfter(std::chrono::milliseconds(100), [](int a) { return a * 2; }, 21);
+    template<typename Func, typename... Args>
+    auto submitAfter(std::chrono::nanoseconds delay, Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        return submitAt(std::chrono::steady_clock::now() + delay, std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    //在time时刻提交可调用对象
+    template<typename Func, typename... Args>
+    auto submitAt(std::chrono::steady_clock::time_point time, Func&& func, Args&&... args)
+        -> Result<typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type>
+    {
+        using RType = typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type;
+        std::shared_ptr<ValueTask<RType>> task = makeFuncTask(std::forward<Func>(func), std::forward<Args>(args)...);
+        addTimer(time, std::chrono::nanoseconds(0), task, nullptr);
+        return Result<RType>(std::move(task), true);
+    }
+
+    //delay之后在线程池里执行一次func 返回的编号可以用来取消 适合大量可能被取消的超时
+    TimerId scheduleAfter(std::chrono::nanoseconds delay, std::function<void()> func);
+
+    //在time时刻执行一次func
+    TimerId scheduleAt(std::chrono::steady_clock::time_point time, std::function<void()> func);
+
+    //每隔period在线程池里执行一次func 第一次在period之后
+    //按固定频率执行 上一次还没执行完时不会重叠执行 错过的次数直接跳过 func抛出的异常记录日志后忽略
+    TimerId scheduleEvery(std::chrono::nanoseconds period, std::function<void()> func);
+
+    //取消定时器 还没到期的一次性定时器不再执行 周期定时器不再安排下一次(正在执行的这次不受影响)
+    //返回定时器是否还有效
+    bool cancelTimer(TimerId id);
+
+    //批量提交任务 整批只加一次锁 按任务数量唤醒空闲线程
+    //队列放不下整批任务时按拒绝策略处理 没有被接受的总是后面的一部分
+    BatchResult<> submitBatch(const std::vector<std::shared_ptr<Task>>& tasks);
+
+    //批量提交一组无参的可调用对象 例如std::vector<std::function<int()>>
+    template<typename Iter>
+    auto submitBatch(Iter first, Iter last)
+        -> BatchResult<typename std::invoke_result<typename std::decay<decltype(*first)>::type>::type>
+    {
+        using Func = typename std::decay<decltype(*first)>::type;
+        using RType = typename std::invoke_result<Func>::type;
+        std::vector<std::shared_ptr<FuncTask<RType, Func>>> funcTasks;
+        std::vector<std::shared_ptr<Task>> tasks;
+        for (; first != last; ++first)
+        {
+            funcTasks.push_back(allocateShared<FuncTask<RType, Func>>(Func(*first)));
+            tasks.push_back(funcTasks.back());
+        }
+
+        size_t accepted = enqueueBatch(tasks.data(), tasks.size(), policyAdmission());
+        std::vector<Result<RType>> results;
+        results.reserve(funcTasks.size());
+        for (size_t i = 0; i < funcTasks.size(); i++)
+        {
+            results.emplace_back(std::move(funcTasks[i]), i < accepted);
+        }
+        return BatchResult<RType>(std::move(results), accepted);
+    }
 
     //开启线程池
     void start(int initThreadSize = std::thread::hardware_concurrency());
 
+    //获取线程池的统计快照 合并各线程的计数器
+    PoolStats stats() const;
+
+    //开启后记录每个任务的入队、开始和结束时间 统计排队等待时间和执行时间的直方图
+    void setTaskTiming(bool enable);
+
+    //空闲线程比排队的任务多 新提交的任务可以马上被执行 并行算法据此决定是否继续拆分任务
+    bool hasIdleThread() const;
+
     //禁止 不让用户这样 对线程池本身进行拷贝构造和赋值 //可以单独构造一个线程池对象
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
 
 private:
+    template<typename U>
+    friend class Result;
+
+    //队列满时入队的处理方式
+    struct Admission
+    {
+        Admission()
+            : timeout_(0)
+            , dropOldest_(false)
+            , callerRuns_(false)
+            , global_(false)
+        {}
+        std::chrono::nanoseconds timeout_; //最多等待的时间 0表示不等待
+        bool dropOldest_; //淘汰全局队列中最早的任务腾出位置
+        bool callerRuns_; //放不下时在提交任务的线程执行
+        bool global_; //工作窃取模式下也不放入当前线程的本地队列 和其他线程提交的任务一起按到达顺序执行
+    };
+
+    //按拒绝策略确定入队的处理方式
+    Admission policyAdmission() const;
+
+    //用taskSize_预留一个队列位置 队列满时按admission淘汰任务或者等待 预留不到返回false
+    //lock是taskQueMtx_上的锁 返回时锁的状态和调用前相同
+    bool reserveTask(std::unique_lock<std::mutex>& lock, const Admission& admission);
+
+    //工作窃取模式下为本地队列预留count个位置 放不下时返回false
+    bool reserveLocal(int count);
+
+    //批量入队时预留最多count个位置 返回预留到的数量
+    size_t reserveBatch(size_t count);
+
+    //淘汰全局队列中最早的任务 全局队列为空时返回false 返回时锁的状态和调用前相同
+    bool dropOldestTask(std::unique_lock<std::mutex>& lock);
+
+    //把可调用对象和参数打包成无参的函数对象 和返回值一起放在同一个任务对象里
+    template<typename Func, typename... Args>
+    static auto makeFuncTask(Func&& func, Args&&... args)
+    {
+        using RType = typename std::invoke_result<typename std::decay<Func>::type, typename std::decay<Args>::type...>::type;
+        auto call = [func = std::forward<Func>(func), args = std::make_tuple(std::forward<Args>(args)...)]() mutable -> RType
+        {
+            return std::apply(func, std::move(args));
+        };
+        return allocateShared<FuncTask<RType, decltype(call)>>(std::move(call));
+    }
+
+    //添加定时器 第一次使用时创建时间轮并启动定时器线程 period为0表示一次性定时器
+    TimerId addTimer(std::chrono::steady_clock::time_point time, std::chrono::nanoseconds period,
+        std::shared_ptr<Task> task, std::shared_ptr<std::function<void()>> func);
+
+    //定时器线程 推进时间轮 把到期的任务成批放入任务队列
+    void TimerFunc();
+
+    //把到期的定时器放入任务队列 放不下的推迟到下一个刻度
+    void fireTimers(std::vector<TimerWheel::Expired>& expired);
+
+    //周期定时器执行完一次后安排下一次
+    void rearmTimer(TimerId id);
+
+    //停止定时器线程 丢弃还没到期的任务
+    void stopTimers();
+
+    //记录任务的优先级和截止时间 入队时据此选择优先级队列
+    static void setTaskPriority(Task* task, TaskPriority priority, std::chrono::steady_clock::time_point deadline);
+
     //定义线程函数
     void ThreadFunc(int threadid);
 
+    //工作窃取模式的线程函数
+    void StealThreadFunc(int threadid);
+
+    //cache模式的控制线程 根据排队时间和吞吐量增减线程
+    void ControllerFunc();
+
+    //cache模式下任务数量超过空闲线程数量时通知控制线程扩容 不在提交线程上创建线程
+    void requestThreads();
+
+    //所有线程完成的任务总数
+    uint64_t completedCount() const;
+
+    //工作窃取模式下取任务：本地队列 -> 本节点队列 -> 全局注入队列 -> 窃取其他线程 -> 其他节点队列
+    std::shared_ptr<Task> findStealTask(WorkStealQueue* localQue, StatsBlock* stats, int node);
+
+    //从全局任务队列取一个任务 有锁队列模式下调用者必须持有taskQueMtx_
+    bool popGlobalTask(std::shared_ptr<Task>& task);
+
+    //普通线程函数取任务：优先级队列的高、普通优先级 -> 本节点队列 -> 全局任务队列 -> 其他节点队列 -> 低优先级
+    //有锁队列模式下调用者必须持有taskQueMtx_ 无锁队列模式下调用者不能持有
+    bool popWorkerTask(std::shared_ptr<Task>& task, int node);
+
+    //从优先级队列取一个任务 lowBand为false时不取未老化的低优先级任务
+    //超过截止时间的任务按设置丢弃 调用者必须持有taskQueMtx_
+    bool popPriorityTask(std::shared_ptr<Task>& task, bool lowBand);
+
+    //带优先级或截止时间的任务入队
+    bool pushPriorityTask(std::shared_ptr<Task> sp, const Admission& admission);
+
+    //带节点提示的任务放入节点队列
+    bool pushNodeTask(std::shared_ptr<Task> sp, const Admission& admission);
+
+    //从节点队列取一个任务 remote为false时只取本节点的 为true时只取其他节点的
+    bool popNodeTask(std::shared_ptr<Task>& task, int node, bool remote);
+
+    //线程启动时按绑核方式和NUMA设置绑定CPU 返回线程所在的节点下标
+    int placeCurrentThread();
+
+    //任务入队并计数 提交失败返回false 默认队列满时不等待
+    bool enqueueTask(std::shared_ptr<Task> sp, const Admission& admission = Admission());
+
+    //把任务放入合适的队列
+    bool pushTask(std::shared_ptr<Task> sp, const Admission& admission);
+
+    //无锁队列模式下任务入队
+    bool enqueueRingTask(std::shared_ptr<Task> sp, const Admission& admission);
+
+    //已经预留了位置的任务放入环形队列 槽位暂时没有释放时等待重试
+    void pushRing(std::shared_ptr<Task> sp);
+
+    //批量入队并计数 返回被接受的任务数量 被接受的总是前面的任务
+    size_t enqueueBatch(const std::shared_ptr<Task>* tasks, size_t count, const Admission& admission);
+
+    //把一批任务放入合适的队列
+    size_t pushBatch(const std::shared_ptr<Task>* tasks, size_t count, const Admission& admission);
+
+    //执行一个从队列取出的任务 已经被等待它的线程直接执行过的跳过并返回false
+    bool runTask(Task* task, StatsBlock* stats);
+
+    //执行任务 记录计时和完成数量
+    void execTask(Task* task, StatsBlock* stats);
+
+    //工作线程取出一个任务后更新排队数量 通知等待队列不满的提交者
+    //有锁队列模式下lock必须持有 无锁队列模式下lock不能持有
+    void taskTaken(std::unique_lock<std::mutex>& lock);
+
+    //工作线程等待done时执行排队的任务 直到done完成
+    void helpUntil(Completion& done, Task* awaited);
+
+    //有新任务入队时叫醒在helpUntil里睡眠的工作线程
+    void wakeHelpers();
+
+    //工作线程等待时取一个任务 取任务的顺序和工作线程相同 没有任务返回nullptr
+    std::shared_ptr<Task> popHelpTask(StatsBlock* stats);
+    friend void helpWait(Completion& done, Task* awaited);
+
+    //当前线程在这个线程池的统计计数 第一次使用时创建
+    StatsBlock* localStats() const;
+
+    //唤醒最多count个睡眠的线程 调用者必须持有taskQueMtx_
+    void wakeThreads(size_t count);
+
+    //空闲线程睡眠前自旋等待新任务
+    bool spinWait();
+
+    //cache模式下创建并启动count个新线程 只由控制线程调用 调用者不能持有taskQueMtx_
+    void addCachedThreads(int count);
+
+    //工作线程进入和离开阻塞区域 阻塞的线程比补偿线程多时唤醒备用的补偿线程或者新建一个
+    void beginBlocking();
+    void endBlocking();
+    friend class BlockingScope;
+
+    //任务组共用的调度器 按线程数量限制交给线程池的任务
+    friend class TaskGroup;
+    friend class GroupScheduler;
+
+    //通过共享句柄提交任务 不直接保存线程池的指针
+    friend class PoolHandle;
+    friend class TaskGraph;
+    friend class IoEngine;
+    friend class TaskBatcher;
+
+    //补偿线程的线程函数 和普通线程一样取任务 阻塞的线程返回后多出来的补偿线程转为备用 备用超时后退出
+    void CompensateFunc(int threadid);
+
+    //补偿线程多于阻塞的线程时转为备用并等待唤醒 需要退出时返回false
+    bool parkSpareThread();
+
     //check pool运行状态
     bool checkRunningState() const;
 
@@ -225,7 +1362,7 @@ private:
     std::atomic_int curThreadSize_;//记录当前线程池的总线程数量
     std::atomic_int idleThreadSize_; // 记录空闲线程的数量
 
-    std::queue<std::shared_ptr<Task>> taskQue_;//任务队列 //基类指针//需要保持生命周期//run完才结束//因此使用智能指针
+    std::queue<std::shared_ptr<Task>, TaskDeque> taskQue_;//任务队列 //基类指针//需要保持生命周期//run完才结束//因此使用智能指针
 
     /*记录任务数量//++--考虑线程安全和轻量*/
     std::atomic_int taskSize_; //任务数量
@@ -238,9 +1375,129 @@ private:
 
     PoolMode poolMode_; // 当前线程池的工作模式
     std::atomic_bool isPoolRunning_;//表示当前线程池的启动状态
+
+    //工作窃取模式：线程id -> 该线程的本地双端队列 start之后不再改变
+    std::unordered_map<int, std::unique_ptr<WorkStealQueue>> localQues_;
+    std::vector<WorkStealQueue*> stealQues_; //窃取时按顺序遍历的队列列表
+    std::atomic_int injectTaskSize_; //全局注入队列taskQue_中的任务数量 避免空查时加锁
+    std::atomic_int sleepThreadSize_; //在notEmpty_上睡眠的线程数量 没有睡眠线程时提交任务不用加锁通知
+
+    TaskQueMode taskQueMode_; //任务队列的实现方式
+    std::unique_ptr<RingQueue<std::shared_ptr<Task>>> ringQue_; //无锁模式下代替taskQue_ start时创建
+
+    int spinCount_; //空闲线程睡眠前的自旋次数
+
+    std::unique_ptr<PriorityTaskQueue> prioQue_; //带优先级或截止时间的任务 由taskQueMtx_保护
+    std::atomic_int prioTaskSize_; //优先级队列中的任务数量 避免空查时加锁
+    uint64_t agingNs_; //低优先级任务的老化时间
+    bool dropExpired_; //是否丢弃超过截止时间的任务
+    RejectPolicy rejectPolicy_; //任务队列满时的拒绝策略
+    std::chrono::nanoseconds blockTime_; //REJECT_BLOCK的最长等待时间
+
+    ThreadAffinity affinity_; //线程绑核方式
+    std::vector<int> affinityCpus_; //绑核使用的CPU集合 为空表示所有在线CPU
+    bool numaAware_; //是否开启NUMA感知
+    std::atomic_int placeIndex_; //下一个启动的线程的序号 按序号轮流分配节点和物理核
+    std::vector<std::unique_ptr<WorkStealQueue>> nodeQues_; //每个NUMA节点的任务队列 多于一个节点时start创建
+    std::atomic_int nodeTaskSize_; //所有节点队列中的任务数量 避免空查时加锁
+
+    int minThreadSize_; //cache模式下保留的最少线程数量 小于0表示初始线程数量
+    std::chrono::milliseconds keepAlive_; //cache模式下多余线程的保活时间
+    std::chrono::microseconds targetWait_; //cache模式下可以接受的排队时间
+    std::thread controller_; //cache模式的控制线程 析构时等待它退出
+    std::mutex ctrlMtx_; //和ctrlCond_一起唤醒控制线程
+    std::condition_variable ctrlCond_;
+    std::atomic_bool ctrlSignaled_; //提交方请求过扩容 控制线程处理后清除
+    std::atomic_int retireThreadSize_; //还要回收的空闲线程数量 睡眠的线程被唤醒后认领
+    std::atomic_int minIdleThreadSize_; //当前保活周期内空闲线程数量的最小值 说明有这么多线程整个周期都没用上
+
+    std::unique_ptr<TimerWheel> timerWheel_; //延时和周期任务 第一次使用时创建 由timerMtx_保护
+    std::thread timerThread_; //推进时间轮的定时器线程 和时间轮一起创建
+    std::mutex timerMtx_;
+    std::condition_variable timerCond_; //添加了更早到期的定时器或者线程池析构时唤醒定时器线程
+    uint64_t timerWakeTick_; //定时器线程下一次醒来的刻度
+    bool timerExit_; //定时器线程需要退出
+
+    std::mutex compMtx_; //保护补偿线程的计数 和compCond_一起唤醒备用的补偿线程
+    std::condition_variable compCond_;
+    std::atomic_int blockedThreadSize_; //在阻塞区域里的工作线程数量
+    std::atomic_int compThreadSize_; //正在工作的补偿线程数量
+    int spareThreadSize_; //备用的补偿线程数量 不取任务 由compMtx_保护
+    int spareWakeSize_; //已经分配给阻塞线程、还没醒来的备用线程数量 由compMtx_保护
+
+    std::mutex helpMtx_; //保护helpWaiters_
+    std::vector<Completion*> helpWaiters_; //在helpUntil里睡眠的工作线程等待的Completion
+    std::atomic_int helpWaiterSize_{ 0 }; //helpWaiters_的数量 提交方先看它再决定要不要加锁
+
+    std::shared_ptr<PoolHandle> handle_; //线程池的共享句柄 构造时创建 析构时关闭
+    std::shared_ptr<GroupScheduler> groupScheduler_; //任务组的调度器 第一次创建任务组时创建 由taskQueMtx_保护
+
+    const uint64_t poolId_; //线程池的唯一编号 线程用它查找自己的统计计数
+    std::atomic_bool taskTiming_; //是否记录任务的时间
+    mutable std::mutex statsMtx_; //保护statsBlocks_
+    mutable std::vector<std::unique_ptr<StatsBlock>> statsBlocks_; //所有线程的统计计数 线程池析构时释放
+};
+
+/*
+标记任务里一段会阻塞的代码 例如阻塞地读文件、等待线程池外部的事件
+阻塞的工作线程不再消耗CPU 线程池临时启用一个补偿线程代替它取任务 可运行的线程数量保持不变
+补偿线程总数不超过线程数量上限阈值 离开作用域后多出来的补偿线程执行完手上的任务就停下来备用 备用一段时间没用上就退出
+不在线程池的工作线程上时什么也不做 嵌套时只有最外层起作用
+
+example:
+pool.submit([fd, buf, size]() {
+    BlockingScope blocking;
+    return read(fd, buf, size);
+});
+*/
+class BlockingScope
+{
+public:
+    BlockingScope();
+    ~BlockingScope();
+    BlockingScope(const BlockingScope&) = delete;
+    BlockingScope& operator=(const BlockingScope&) = delete;
+
+private:
+    ThreadPool* pool_; //当前线程所属的线程池 不是工作线程时为nullptr
 };
 
 
 
+template<typename T>
+template<typename F>
+auto Result<T>::then(F&& func) && -> Result<typename ThenResult<T, F>::type>
+{
+    using U = typename ThenResult<T, F>::type;
+    if (!isValid_)
+    {
+        return Result<U>(nullptr, false);
+    }
+    std::shared_ptr<ValueTask<T>> prev = std::move(task_);
+    isValid_ = false;
+
+    auto call = [prev, func = std::forward<F>(func)]() mutable -> U
+    {
+        if constexpr (std::is_void<T>::value)
+        {
+            prev->takeValue();
+            return func();
+        }
+        else
+        {
+            return func(prev->takeValue());
+        }
+    };
+    auto next = allocateShared<FuncTask<U, decltype(call)>>(std::move(call));
+    next->pool_ = prev->pool_;
+
+    //前一个任务完成时提交后续任务 队列满或者线程池已经析构时在当前线程直接执行 保证后续任务不会丢失
+    prev->addContinuation([next]() {
+        std::shared_ptr<PoolHandle> pool = next->pool_;
+        if (pool == nullptr || !pool->trySubmitTask(next))
+            next->exec();
+    });
+    return Result<U>(std::move(next), true);
+}
 
 #endif
\ No newline at end of file
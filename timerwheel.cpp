@@ -0,0 +1,301 @@
+#include "timerwheel.h"
+
+//位图里从from开始(含)循环向后的第一个非空槽 返回距离 没有非空槽返回-1
+static int findSlot(const uint64_t* bits, uint32_t from)
+{
+    const uint32_t slotCount = 256;
+    for (uint32_t offset = 0; offset < slotCount; )
+    {
+        uint32_t slot = (from + offset) % slotCount;
+        uint64_t word = bits[slot / 64] >> (slot % 64);
+        if (word != 0)
+            return (int)(offset + __builtin_ctzll(word));
+        offset += 64 - slot % 64;
+    }
+    return -1;
+}
+
+TimerWheel::TimerWheel(std::chrono::nanoseconds tick)
+    : start_(std::chrono::steady_clock::now())
+    , tickNs_(tick.count() > 0 ? (uint64_t)tick.count() : 1)
+    , current_(0)
+    , size_(0)
+    , freeHead_(NIL)
+{
+    for (uint32_t& head : slots_)
+        head = NIL;
+    for (auto& level : occupied_)
+        for (uint64_t& word : level)
+            word = 0;
+}
+
+TimerId TimerWheel::add(uint64_t expire, uint64_t period, std::shared_ptr<Task> task,
+    std::shared_ptr<std::function<void()>> func)
+{
+    uint32_t index = freeHead_;
+    if (index != NIL)
+    {
+        freeHead_ = nodes_[index].next_;
+    }
+    else
+    {
+        index = (uint32_t)nodes_.size();
+        nodes_.emplace_back();
+    }
+
+    Node& node = nodes_[index];
+    //当前刻度已经处理过 最早在下一个刻度到期
+    node.expire_ = expire > current_ ? expire : current_ + 1;
+    node.period_ = period;
+    node.task_ = std::move(task);
+    node.func_ = std::move(func);
+    link(index);
+    size_++;
+    return ((TimerId)node.gen_ << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+    uint32_t index;
+    Node* node = find(id, index);
+    if (node == nullptr)
+        return false;
+    if (node->state_ == NODE_ARMED)
+        unlink(index);
+    release(index);
+    return true;
+}
+
+bool TimerWheel::rearm(TimerId id)
+{
+    uint32_t index;
+    Node* node = find(id, index);
+    if (node == nullptr || node->state_ != NODE_RUNNING)
+        return false;
+
+    //固定频率 执行得太慢错过的几次直接跳过 保持原来的相位
+    uint64_t expire = node->expire_ + node->period_;
+    if (expire <= current_)
+        expire += ((current_ - expire) / node->period_ + 1) * node->period_;
+    node->expire_ = expire;
+    link(index);
+    return true;
+}
+
+void TimerWheel::advance(uint64_t tick, std::vector<Expired>& out)
+{
+    const uint64_t levelMask = SLOT_COUNT - 1;
+    while (current_ < tick)
+    {
+        if (size_ == 0)
+        {
+            current_ = tick;
+            break;
+        }
+
+        //第0层没有定时器时直接跳到下一次级联之前
+        if (findSlot(occupied_[0], 0) < 0)
+        {
+            uint64_t boundary = (current_ | levelMask) + 1;
+            if (boundary > tick)
+            {
+                current_ = tick;
+                break;
+            }
+            current_ = boundary - 1;
+        }
+
+        uint64_t t = ++current_;
+        //走到某层的边界时 从高层到低层依次级联
+        if ((t & levelMask) == 0)
+        {
+            for (int level = LEVEL_COUNT - 1; level >= 1; level--)
+            {
+                uint64_t lowMask = (1ULL << (LEVEL_BITS * level)) - 1;
+                if ((t & lowMask) == 0)
+                    cascade(level, (uint32_t)((t >> (LEVEL_BITS * level)) & levelMask));
+            }
+        }
+
+        //第0层当前槽里的定时器全部到期
+        uint32_t slot = (uint32_t)(t & levelMask);
+        uint32_t index = slots_[slot];
+        slots_[slot] = NIL;
+        occupied_[0][slot / 64] &= ~(1ULL << (slot % 64));
+        while (index != NIL)
+        {
+            Node& node = nodes_[index];
+            uint32_t next = node.next_;
+            Expired expired;
+            expired.id_ = ((TimerId)node.gen_ << 32) | index;
+            expired.expire_ = node.expire_;
+            expired.periodic_ = node.period_ != 0;
+            if (expired.periodic_)
+            {
+                expired.func_ = node.func_;
+                node.state_ = NODE_RUNNING;
+                node.prev_ = node.next_ = NIL;
+            }
+            else
+            {
+                expired.task_ = std::move(node.task_);
+                release(index);
+            }
+            out.push_back(std::move(expired));
+            index = next;
+        }
+    }
+}
+
+void TimerWheel::clear(std::vector<std::shared_ptr<Task>>& out)
+{
+    for (uint32_t index = 0; index < (uint32_t)nodes_.size(); index++)
+    {
+        Node& node = nodes_[index];
+        if (node.state_ == NODE_FREE)
+            continue;
+        if (node.task_ != nullptr)
+            out.push_back(std::move(node.task_));
+        if (node.state_ == NODE_ARMED)
+            unlink(index);
+        release(index);
+    }
+}
+
+uint64_t TimerWheel::nextTick() const
+{
+    const uint64_t levelMask = SLOT_COUNT - 1;
+    uint64_t next = UINT64_MAX;
+    int dist = findSlot(occupied_[0], (uint32_t)((current_ + 1) & levelMask));
+    if (dist >= 0)
+        next = current_ + 1 + dist;
+
+    //上面几层 下一次级联非空槽的刻度
+    for (int level = 1; level < LEVEL_COUNT; level++)
+    {
+        uint64_t block = current_ >> (LEVEL_BITS * level);
+        dist = findSlot(occupied_[level], (uint32_t)((block + 1) & levelMask));
+        if (dist >= 0)
+        {
+            uint64_t boundary = (block + 1 + dist) << (LEVEL_BITS * level);
+            if (boundary < next)
+                next = boundary;
+        }
+    }
+    return next;
+}
+
+uint64_t TimerWheel::tickOf(std::chrono::steady_clock::time_point time) const
+{
+    if (time <= start_)
+        return 0;
+    uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(time - start_).count();
+    return (ns + tickNs_ - 1) / tickNs_;
+}
+
+uint64_t TimerWheel::ticksOf(std::chrono::nanoseconds duration) const
+{
+    if (duration.count() <= 0)
+        return 0;
+    return ((uint64_t)duration.count() + tickNs_ - 1) / tickNs_;
+}
+
+std::chrono::steady_clock::time_point TimerWheel::timeOf(uint64_t tick) const
+{
+    return start_ + std::chrono::nanoseconds(tick * tickNs_);
+}
+
+uint64_t TimerWheel::nowTick() const
+{
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / tickNs_;
+}
+
+size_t TimerWheel::size() const
+{
+    return size_;
+}
+
+TimerWheel::Node* TimerWheel::find(TimerId id, uint32_t& index)
+{
+    index = (uint32_t)(id & 0xFFFFFFFFu);
+    if (index >= nodes_.size())
+        return nullptr;
+    Node& node = nodes_[index];
+    if (node.state_ == NODE_FREE || node.gen_ != (uint32_t)(id >> 32))
+        return nullptr;
+    return &node;
+}
+
+void TimerWheel::link(uint32_t index)
+{
+    const uint64_t levelMask = SLOT_COUNT - 1;
+    Node& node = nodes_[index];
+    uint64_t expire = node.expire_;
+    uint64_t delta = expire > current_ ? expire - current_ : 0;
+
+    int level = 0;
+    while (level < LEVEL_COUNT - 1 && delta >= (1ULL << (LEVEL_BITS * (level + 1))))
+        level++;
+    //超出最高层的范围 先放在最高层最远的槽 级联时重新计算
+    if (level == LEVEL_COUNT - 1 && delta >= (1ULL << (LEVEL_BITS * LEVEL_COUNT)) - 1)
+        expire = current_ + (1ULL << (LEVEL_BITS * LEVEL_COUNT)) - 1;
+    uint32_t slot = (uint32_t)((expire >> (LEVEL_BITS * level)) & levelMask);
+
+    uint32_t head = level * SLOT_COUNT + slot;
+    node.slot_ = head;
+    node.state_ = NODE_ARMED;
+    node.prev_ = NIL;
+    node.next_ = slots_[head];
+    if (slots_[head] != NIL)
+        nodes_[slots_[head]].prev_ = index;
+    slots_[head] = index;
+    occupied_[level][slot / 64] |= 1ULL << (slot % 64);
+}
+
+void TimerWheel::unlink(uint32_t index)
+{
+    Node& node = nodes_[index];
+    if (node.prev_ != NIL)
+        nodes_[node.prev_].next_ = node.next_;
+    else
+        slots_[node.slot_] = node.next_;
+    if (node.next_ != NIL)
+        nodes_[node.next_].prev_ = node.prev_;
+    if (slots_[node.slot_] == NIL)
+    {
+        uint32_t level = node.slot_ / SLOT_COUNT;
+        uint32_t slot = node.slot_ % SLOT_COUNT;
+        occupied_[level][slot / 64] &= ~(1ULL << (slot % 64));
+    }
+    node.prev_ = node.next_ = NIL;
+}
+
+void TimerWheel::release(uint32_t index)
+{
+    Node& node = nodes_[index];
+    node.task_.reset();
+    node.func_.reset();
+    node.state_ = NODE_FREE;
+    //代数加一 旧编号失效 跳过0 保证编号不为0
+    if (++node.gen_ == 0)
+        node.gen_ = 1;
+    node.prev_ = NIL;
+    node.next_ = freeHead_;
+    freeHead_ = index;
+    size_--;
+}
+
+void TimerWheel::cascade(int level, uint32_t slot)
+{
+    uint32_t head = level * SLOT_COUNT + slot;
+    uint32_t index = slots_[head];
+    slots_[head] = NIL;
+    occupied_[level][slot / 64] &= ~(1ULL << (slot % 64));
+    while (index != NIL)
+    {
+        uint32_t next = nodes_[index].next_;
+        link(index);
+        index = next;
+    }
+}
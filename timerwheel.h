@@ -0,0 +1,118 @@
+/*分层时间轮 线程池的延时任务和周期任务按到期刻度挂在这里*/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+class Task;
+
+//定时器编号 高32位是节点的代数 低32位是节点下标 节点回收后旧编号自动失效 0表示无效
+using TimerId = uint64_t;
+
+/*
+4层 每层256个槽 刻度为tick：第0层覆盖256个刻度 第1层65536个 第2层2^24个 第3层2^32个
+定时器按到期刻度和当前刻度的距离放入对应层的槽 每个槽是一条双向链表 插入和取消都是O(1)
+当前刻度走到某层的边界时 把上一层对应槽里的定时器重新分配到下面的层(级联)
+超过第3层范围的定时器先放在第3层 级联时再重新计算
+节点放在deque里 下标不变 回收后放入空闲链表复用 不逐个分配内存
+不是线程安全的 由ThreadPool的timerMtx_保护
+*/
+class TimerWheel
+{
+public:
+    //到期的定时器 一次性定时器的节点已经回收 周期定时器的节点等待rearm或者cancel
+    struct Expired
+    {
+        TimerId id_;
+        uint64_t expire_;                            //到期刻度
+        bool periodic_;                              //是否周期定时器
+        std::shared_ptr<Task> task_;                 //一次性定时器到期时放入任务队列的任务
+        std::shared_ptr<std::function<void()>> func_; //周期定时器每次到期时执行的函数
+    };
+
+    explicit TimerWheel(std::chrono::nanoseconds tick);
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    //添加定时器 expire已经过去时在下一个刻度到期 period为0表示一次性定时器
+    TimerId add(uint64_t expire, uint64_t period, std::shared_ptr<Task> task,
+        std::shared_ptr<std::function<void()>> func);
+
+    //取消定时器 定时器还没到期或者是周期定时器时返回true
+    bool cancel(TimerId id);
+
+    //周期定时器执行完一次后按固定频率安排下一次 错过的次数直接跳过 已经取消返回false
+    bool rearm(TimerId id);
+
+    //当前刻度推进到tick 到期的定时器追加到out
+    void advance(uint64_t tick, std::vector<Expired>& out);
+
+    //取出所有还没到期的一次性定时器的任务 回收所有节点
+    void clear(std::vector<std::shared_ptr<Task>>& out);
+
+    //下一次需要推进的刻度 有定时器在当前层到期或者需要级联 没有定时器返回UINT64_MAX
+    uint64_t nextTick() const;
+
+    //时间和刻度的换算 时间向上取整 定时器不会提前到期
+    uint64_t tickOf(std::chrono::steady_clock::time_point time) const;
+    uint64_t ticksOf(std::chrono::nanoseconds duration) const;
+    std::chrono::steady_clock::time_point timeOf(uint64_t tick) const;
+
+    //现在的时间所在的刻度 向下取整 定时器线程推进到这个刻度
+    uint64_t nowTick() const;
+
+    //等待中的定时器数量 包括正在执行的周期定时器
+    size_t size() const;
+
+private:
+    static const int LEVEL_COUNT = 4;
+    static const int LEVEL_BITS = 8;
+    static const uint32_t SLOT_COUNT = 1u << LEVEL_BITS;
+    static const uint32_t NIL = UINT32_MAX;
+
+    //节点状态
+    static const uint32_t NODE_FREE = 0;    //在空闲链表里
+    static const uint32_t NODE_ARMED = 1;   //挂在某个槽里
+    static const uint32_t NODE_RUNNING = 2; //周期定时器到期后等待下一次安排
+
+    struct Node
+    {
+        uint32_t prev_ = NIL;
+        uint32_t next_ = NIL;
+        uint32_t gen_ = 1;
+        uint32_t state_ = NODE_FREE;
+        uint32_t slot_ = 0; //所在槽在slots_中的下标
+        uint64_t expire_ = 0;
+        uint64_t period_ = 0;
+        std::shared_ptr<Task> task_;
+        std::shared_ptr<std::function<void()>> func_;
+    };
+
+    //编号对应的节点 编号已经失效返回nullptr
+    Node* find(TimerId id, uint32_t& index);
+
+    //按到期刻度把节点挂到对应的槽
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+
+    //把level层的slot槽里的节点重新分配到下面的层
+    void cascade(int level, uint32_t slot);
+
+    std::chrono::steady_clock::time_point start_;
+    uint64_t tickNs_;
+    uint64_t current_; //已经处理完的刻度
+    size_t size_;
+    std::deque<Node> nodes_;
+    uint32_t freeHead_;
+    uint32_t slots_[LEVEL_COUNT * SLOT_COUNT];
+    uint64_t occupied_[LEVEL_COUNT][SLOT_COUNT / 64]; //非空槽的位图 计算下一次唤醒时不用遍历链表
+};
+
+#endif
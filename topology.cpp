@@ -0,0 +1,206 @@
+#include "topology.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <stdlib.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+const char* SYS_CPU_PATH = "/sys/devices/system/cpu";
+const char* SYS_NODE_PATH = "/sys/devices/system/node";
+
+//读取/sys下的一行文本 文件不存在返回false
+static bool readLine(const std::string& path, std::string& line)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::getline(in, line);
+    return true;
+}
+
+//读取/sys下的一个整数 失败返回defaultValue
+static int readInt(const std::string& path, int defaultValue)
+{
+    std::string line;
+    if (!readLine(path, line) || line.empty())
+        return defaultValue;
+    return atoi(line.c_str());
+}
+
+const CpuTopology& CpuTopology::instance()
+{
+    static CpuTopology topology;
+    return topology;
+}
+
+CpuTopology::CpuTopology()
+    : nodeCount_(1)
+{
+    if (!load())
+        loadFallback();
+}
+
+//从/sys读取在线CPU、物理核和NUMA节点
+bool CpuTopology::load()
+{
+#ifdef __linux__
+    std::string line;
+    if (!readLine(std::string(SYS_CPU_PATH) + "/online", line))
+        return false;
+    std::vector<int> online = parseCpuList(line);
+    if (online.empty())
+        return false;
+
+    //CPU -> 节点下标 只统计有CPU的节点
+    std::map<int, int> cpuNode;
+    int nodeCount = 0;
+    std::string nodeLine;
+    if (readLine(std::string(SYS_NODE_PATH) + "/online", nodeLine))
+    {
+        for (int node : parseCpuList(nodeLine))
+        {
+            std::string cpuLine;
+            if (!readLine(std::string(SYS_NODE_PATH) + "/node" + std::to_string(node) + "/cpulist", cpuLine))
+                continue;
+            std::vector<int> nodeCpus = parseCpuList(cpuLine);
+            if (nodeCpus.empty())
+                continue; //只有内存没有CPU的节点
+            for (int cpu : nodeCpus)
+                cpuNode[cpu] = nodeCount;
+            nodeCount++;
+        }
+    }
+
+    for (int cpu : online)
+    {
+        std::string topo = std::string(SYS_CPU_PATH) + "/cpu" + std::to_string(cpu) + "/topology/";
+        Cpu info;
+        info.id_ = cpu;
+        info.package_ = readInt(topo + "physical_package_id", 0);
+        //core_id只在同一个插槽内唯一 和插槽编号组合成全局的物理核编号
+        info.core_ = info.package_ * 65536 + readInt(topo + "core_id", cpu);
+        auto it = cpuNode.find(cpu);
+        info.node_ = it == cpuNode.end() ? 0 : it->second;
+        cpus_.push_back(info);
+    }
+    nodeCount_ = nodeCount > 0 ? nodeCount : 1;
+    return true;
+#else
+    return false;
+#endif
+}
+
+//读不到拓扑时 一个节点 每个CPU一个物理核
+void CpuTopology::loadFallback()
+{
+    cpus_.clear();
+    int count = (int)std::thread::hardware_concurrency();
+    if (count <= 0)
+        count = 1;
+    for (int cpu = 0; cpu < count; cpu++)
+    {
+        cpus_.push_back(Cpu{ cpu, cpu, 0, 0 });
+    }
+    nodeCount_ = 1;
+}
+
+const std::vector<CpuTopology::Cpu>& CpuTopology::cpus() const
+{
+    return cpus_;
+}
+
+int CpuTopology::nodeCount() const
+{
+    return nodeCount_;
+}
+
+std::vector<int> CpuTopology::nodeCpus(int node) const
+{
+    std::vector<int> result;
+    for (const Cpu& cpu : cpus_)
+    {
+        if (cpu.node_ == node)
+            result.push_back(cpu.id_);
+    }
+    return result;
+}
+
+std::vector<int> CpuTopology::physicalCores(const std::vector<int>& allowed, int node) const
+{
+    std::vector<int> result;
+    std::vector<int> seenCores;
+    for (const Cpu& cpu : cpus_)
+    {
+        if (node >= 0 && cpu.node_ != node)
+            continue;
+        if (!allowed.empty() && std::find(allowed.begin(), allowed.end(), cpu.id_) == allowed.end())
+            continue;
+        if (std::find(seenCores.begin(), seenCores.end(), cpu.core_) != seenCores.end())
+            continue; //同一物理核上已经选了一个逻辑CPU
+        seenCores.push_back(cpu.core_);
+        result.push_back(cpu.id_);
+    }
+    return result;
+}
+
+int CpuTopology::nodeOfCpu(int cpu) const
+{
+    for (const Cpu& info : cpus_)
+    {
+        if (info.id_ == cpu)
+            return info.node_;
+    }
+    return 0;
+}
+
+int CpuTopology::currentNode() const
+{
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if (cpu >= 0)
+        return nodeOfCpu(cpu);
+#endif
+    return 0;
+}
+
+std::vector<int> CpuTopology::parseCpuList(const std::string& list)
+{
+    std::vector<int> result;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        if (range.empty() || range[0] < '0' || range[0] > '9')
+            continue;
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; cpu++)
+            result.push_back(cpu);
+    }
+    return result;
+}
+
+bool bindCurrentThread(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+    if (cpus.empty())
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
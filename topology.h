@@ -0,0 +1,62 @@
+/*CPU和NUMA拓扑 用于线程绑核和按节点分配任务*/
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <vector>
+#include <string>
+
+//Linux下从/sys/devices/system读取 进程启动后只读取一次
+//读取失败或者其他平台时退化为一个节点、hardware_concurrency个CPU、每个CPU一个物理核
+//节点编号是有CPU的节点按系统编号排序后的下标 0到nodeCount()-1 通常和系统的节点编号相同
+class CpuTopology
+{
+public:
+    struct Cpu
+    {
+        int id_;      //逻辑CPU编号
+        int core_;    //物理核编号 同一物理核上的超线程兄弟相同
+        int package_; //CPU插槽编号
+        int node_;    //NUMA节点下标
+    };
+
+    static const CpuTopology& instance();
+
+    //在线的逻辑CPU 按编号排序
+    const std::vector<Cpu>& cpus() const;
+
+    //有CPU的NUMA节点数量 至少为1
+    int nodeCount() const;
+
+    //节点上的所有逻辑CPU
+    std::vector<int> nodeCpus(int node) const;
+
+    //每个物理核取编号最小的逻辑CPU 跳过超线程兄弟 allowed不为空时只在其中选择
+    //node >= 0 时只取这个节点上的核
+    std::vector<int> physicalCores(const std::vector<int>& allowed, int node = -1) const;
+
+    //逻辑CPU所在的节点 未知的CPU返回0
+    int nodeOfCpu(int cpu) const;
+
+    //当前线程正在运行的CPU所在的节点
+    int currentNode() const;
+
+    //解析"0-3,8,10-11"格式的CPU列表
+    static std::vector<int> parseCpuList(const std::string& list);
+
+    CpuTopology(const CpuTopology&) = delete;
+    CpuTopology& operator=(const CpuTopology&) = delete;
+
+private:
+    CpuTopology();
+    bool load();
+    void loadFallback();
+
+    std::vector<Cpu> cpus_;
+    int nodeCount_;
+};
+
+//把当前线程绑定到cpus中的CPU上 成功返回true 非Linux平台或者cpus为空时什么也不做返回false
+bool bindCurrentThread(const std::vector<int>& cpus);
+
+#endif